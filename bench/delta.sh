@@ -0,0 +1,60 @@
+#!/bin/sh
+#
+# Compares the bytes written by a delta sink with those of a lemonbar sink 
+# (full frames) for a bar with a 1 Hz clock among otherwise static blocks.
+#
+# Usage: bench/delta.sh [num-blocks] [seconds] [succade-binary]
+
+BLOCKS=${1:-40}
+DURATION=${2:-10}
+SUCCADE=${3:-./bin/succade}
+
+DIR=$(mktemp -d) || exit 1
+trap 'rm -rf "$DIR"' EXIT
+
+CFG="$DIR/succaderc"
+NAMES=""
+i=1
+while [ $i -lt "$BLOCKS" ]
+do
+	NAMES="$NAMES b$i"
+	i=$((i + 1))
+done
+
+cat > "$CFG" <<CFG
+[bar]
+command = "sh -c 'cat > /dev/null'"
+blocks = "clock$NAMES"
+separator = " | "
+sinks = "delta:$DIR/delta lemonbar:$DIR/full"
+
+[default]
+prefix = "["
+suffix = "]"
+underline = true
+
+[clock]
+command = "date +%H:%M:%S"
+interval = 1
+CFG
+
+i=1
+while [ $i -lt "$BLOCKS" ]
+do
+	printf '\n[b%d]\ncommand = "echo block %d"\n' $i $i >> "$CFG"
+	i=$((i + 1))
+done
+
+# succade checks for X, but the bar used here doesn't need it
+DISPLAY=${DISPLAY:-:0} timeout -s INT "$DURATION" "$SUCCADE" -c "$CFG" > /dev/null
+
+FULL=$(wc -c < "$DIR/full")
+DELTA=$(wc -c < "$DIR/delta")
+FRAMES=$(wc -l < "$DIR/full")
+KEYS=$(grep -c '^key$' "$DIR/delta")
+
+echo "blocks:  $BLOCKS"
+echo "frames:  $FRAMES ($KEYS keyframes)"
+echo "full:    $FULL bytes"
+echo "delta:   $DELTA bytes"
+[ "$FULL" -gt 0 ] && echo "ratio:   $((DELTA * 100 / FULL))%"
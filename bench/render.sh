@@ -0,0 +1,100 @@
+#!/bin/sh
+#
+# Measures how much CPU time succade spends per frame, for a bar with a 
+# number of styled blocks, some of which change their output continuously.
+# Frames are counted by the bar, CPU time is taken from /proc, so this can 
+# be run against older builds just as well, to compare them.
+#
+# Usage: bench/render.sh [num-blocks] [num-changing] [seconds] [plain|percent] [succade-binary]
+#
+# With "percent", the changing blocks print outputs full of '%' signs, 
+# which need to be escaped; with "plain", they print none at all.
+
+BLOCKS=${1:-40}
+CHANGING=${2:-1}
+DURATION=${3:-10}
+OUTPUT=${4:-plain}
+SUCCADE=${5:-./bin/succade}
+
+DIR=$(mktemp -d) || exit 1
+trap 'rm -rf "$DIR"' EXIT
+
+if [ "$OUTPUT" = "percent" ]
+then
+	LINE='$i%% cpu 100%% mem 5%% %%%%%%%%'
+else
+	LINE='$i cpu 12 mem 5 load 0.42'
+fi
+
+cat > "$DIR/tick.sh" <<TICK
+#!/bin/sh
+i=0
+while :
+do
+	i=\$((i + 1))
+	printf "$LINE\n"
+	sleep 0.01
+done
+TICK
+chmod +x "$DIR/tick.sh"
+
+CFG="$DIR/succaderc"
+NAMES=""
+i=0
+while [ $i -lt "$BLOCKS" ]
+do
+	NAMES="$NAMES b$i"
+	i=$((i + 1))
+done
+
+cat > "$CFG" <<CFG
+[bar]
+command = "sh -c 'wc -l > $DIR/frames'"
+blocks = "$NAMES"
+separator = " | "
+
+[default]
+prefix = "["
+suffix = "]"
+label-foreground = "#FFAA00"
+foreground = "#EEEEEE"
+background = "#222222"
+underline = true
+padding-left = 1
+padding-right = 1
+CFG
+
+i=0
+while [ $i -lt "$BLOCKS" ]
+do
+	if [ $i -lt "$CHANGING" ]
+	then
+		# The argument keeps succade from merging them into one process
+		printf '\n[b%d]\ncommand = "%s %d"\nlive = true\n' $i "$DIR/tick.sh" $i >> "$CFG"
+	else
+		printf '\n[b%d]\ncommand = "echo block %d"\nlabel = "B%d:"\n' $i $i $i >> "$CFG"
+	fi
+	printf 'mouse-left = "true"\n' >> "$CFG"
+	i=$((i + 1))
+done
+
+# succade checks for X, but the bar used here doesn't need it
+DISPLAY=${DISPLAY:-:0} "$SUCCADE" -c "$CFG" > /dev/null &
+PID=$!
+sleep "$DURATION"
+
+# utime plus stime, in clock ticks
+TICKS=$(awk '{ print $14 + $15 }' "/proc/$PID/stat")
+kill -INT $PID
+wait $PID
+sleep 0.5
+
+HZ=$(getconf CLK_TCK)
+FRAMES=$(cat "$DIR/frames" 2>/dev/null)
+FRAMES=${FRAMES:-0}
+USEC=$((TICKS * 1000000 / HZ))
+
+echo "blocks:    $BLOCKS ($CHANGING changing, $OUTPUT output)"
+echo "frames:    $FRAMES"
+echo "cpu:       $((USEC / 1000)) ms"
+[ "$FRAMES" -gt 0 ] && echo "per frame: $((USEC / FRAMES)) us"
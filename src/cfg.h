@@ -105,6 +105,19 @@ void cfg_set_str(cfg_s *cfg, size_t idx, char *val)
 	cfg->type[idx] = OPT_TYPE_STRING;
 }
 
+void cfg_unset(cfg_s *cfg, size_t idx)
+{
+	if (idx >= cfg->size)
+		return;
+
+	if (cfg->type[idx] == OPT_TYPE_STRING)
+	{
+		free(cfg->opts[idx].s);
+	}
+	cfg->opts[idx] = (cfg_opt_u) { 0 };
+	cfg->type[idx] = OPT_TYPE_NONE;
+}
+
 cfg_opt_u *cfg_get(cfg_s *cfg, size_t idx)
 {
 	return cfg_has(cfg, idx) ? &cfg->opts[idx] : NULL;
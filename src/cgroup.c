@@ -0,0 +1,132 @@
+#include <stdio.h>     // snprintf(), fopen(), fgets(), ...
+#include <stdlib.h>    // malloc(), free(), strtoll()
+#include <string.h>    // strlen(), strncmp()
+#include <errno.h>     // errno, EEXIST, EBUSY
+#include <time.h>      // nanosleep()
+#include <unistd.h>    // rmdir()
+#include <sys/stat.h>  // mkdir()
+#include <sys/types.h> // pid_t
+
+/*
+ * Writes the string `val` to the control file `file` within the cgroup
+ * directory `dir`, for example "cpu.max" or "cgroup.procs".
+ * Returns 0 on success, -1 on error.
+ */
+int cgroup_write(const char *dir, const char *file, const char *val)
+{
+	char *path = filepath(dir, file, NULL);
+	FILE *fp = fopen(path, "w");
+	free(path);
+
+	if (fp == NULL)
+	{
+		return -1;
+	}
+
+	// The kernel reports errors (invalid value, ...) on write or close
+	int res = fputs(val, fp) == EOF ? -1 : 0;
+	return (fclose(fp) == 0) ? res : -1;
+}
+
+/*
+ * Reads the control file `file` within the cgroup directory `dir` and returns
+ * the number found after `key` (for flat-keyed files like "cpu.stat") or, if
+ * `key` is NULL, the first number in the file (for files like "memory.current").
+ * Returns -1 if the file could not be read or the key was not found.
+ */
+long long cgroup_read(const char *dir, const char *file, const char *key)
+{
+	char *path = filepath(dir, file, NULL);
+	FILE *fp = fopen(path, "r");
+	free(path);
+
+	if (fp == NULL)
+	{
+		return -1;
+	}
+
+	long long val = -1;
+	size_t key_len = key ? strlen(key) : 0;
+	char line[128];
+
+	while (fgets(line, sizeof(line), fp) != NULL)
+	{
+		if (key == NULL)
+		{
+			val = strtoll(line, NULL, 10);
+			break;
+		}
+		if (strncmp(line, key, key_len) == 0 && line[key_len] == ' ')
+		{
+			val = strtoll(line + key_len + 1, NULL, 10);
+			break;
+		}
+	}
+
+	fclose(fp);
+	return val;
+}
+
+/*
+ * Creates the leaf cgroup `name` below the cgroup directory `root`, creating
+ * `root` itself if necessary and enabling the cpu and memory controllers for
+ * its children. `root` needs to be on a writable (delegated) cgroup2 mount.
+ * Returns the path of the leaf, allocated with malloc(), or NULL on error.
+ */
+char *cgroup_leaf(const char *root, const char *name)
+{
+	if (mkdir(root, 0755) == -1 && errno != EEXIST)
+	{
+		return NULL;
+	}
+
+	// This fails if a controller has not been delegated to us; we can
+	// still use the leaf for accounting, so we carry on regardless
+	cgroup_write(root, "cgroup.subtree_control", "+cpu +memory");
+
+	char *leaf = filepath(root, name, NULL);
+	if (mkdir(leaf, 0755) == -1 && errno != EEXIST)
+	{
+		free(leaf);
+		return NULL;
+	}
+
+	return leaf;
+}
+
+/*
+ * Moves the process with the given PID into the cgroup directory `dir`.
+ * Returns 0 on success, -1 on error.
+ */
+int cgroup_attach(const char *dir, pid_t pid)
+{
+	char pid_str[BUFFER_NUMERIC * 2];
+	snprintf(pid_str, sizeof(pid_str), "%d", (int) pid);
+	return cgroup_write(dir, "cgroup.procs", pid_str);
+}
+
+/*
+ * Kills all processes in the cgroup directory `dir` and removes it, which is
+ * only possible once they are gone; we give them CGROUP_REMOVE_TRIES times 
+ * 10 ms to do so. Needs a kernel with cgroup.kill (5.14) to kill processes 
+ * that haven't been killed otherwise. Returns 0 on success, -1 on error.
+ */
+int cgroup_remove(const char *dir)
+{
+	cgroup_write(dir, "cgroup.kill", "1");
+
+	struct timespec pause = { 0, 10 * 1000 * 1000 };
+	for (int i = 0; i < CGROUP_REMOVE_TRIES; ++i)
+	{
+		if (rmdir(dir) == 0 || errno == ENOENT)
+		{
+			return 0;
+		}
+		if (errno != EBUSY)
+		{
+			return -1;
+		}
+		nanosleep(&pause, NULL);
+	}
+	return -1;
+}
@@ -1,7 +1,9 @@
-#include <stdio.h>  // snprintf()
+#include <stdio.h>  // snprintf(), vsnprintf()
+#include <stdarg.h> // va_list, va_start(), va_end()
 #include <stdlib.h> // malloc(), free(), getenv()
 #include <string.h> // strlen(), strcmp()
 #include <time.h>   // clock_gettime(), clockid_t, struct timespec
+#include <stdint.h> // uint64_t
 
 /*
  * Returns 1 if both input strings are equal, otherwise 0.
@@ -56,62 +58,6 @@ char *unquote(const char *str)
 	return trimmed;
 }
 
-/*
- * Escapes the given string `str` by finding all occurences of the character
- * given in `e`, then creating a new string where each occurence of `e` will 
- * have another one prepended in front of it. The new string is allocated with 
- * malloc(), so it is upon the caller to free the result at some point. 
- * If `diff` is not NULL, it will be set to the number of inserted characters, 
- * effectively giving the difference in size between `str` and the result.
- * `str` is assumed to be null terminated, otherwise the behavior is undefined.
- */
-char *escape(const char *str, const char e, size_t *diff)
-{
-	char   c = 0; // current char
-	size_t i = 0; // index of current char
-	size_t n = 0; // number of `e` chars found
-
-	// Count the occurences of `e` in `str`
-	while ((c = str[i]) != '\0')
-	{
-		if (c == e)
-		{
-			++n;
-		}
-		++i;
-	}
-
-	// Return the number of `e`s in `str` via `diff`
-	if (diff != NULL)
-	{
-		*diff = n;
-	}
-
-	// Allocate memory for the escaped string
-	char *escstr = malloc(i + n + 1); 
-
-	// Create the escaped string
-	size_t k = 0;
-	for (size_t j = 0; j < i; ++j)
-	{
-		// Insert two `e` if we find one `e` char
-		if (str[j] == e)
-		{
-			escstr[k++] = e;
-			escstr[k++] = e;
-		}
-		// Otherwise just copy the char as is
-		else
-		{
-			escstr[k++] = str[j];
-		}
-	}
-	
-	// Add the null terminator and return
-	escstr[k] = '\0';
-	return escstr;
-}
-
 /*
  * Returns the first string, unless it is empty or NULL, in which the same 
  * check is performed on the second string and it will be returned. If the 
@@ -131,32 +77,6 @@ const char *strsel(const char *str1, const char *str2,  const char *fb)
 	return fb;
 }
 
-/*
- * Creates a string suitable for use as a command line option, where the given 
- * character `o` will be used for the switch/option and the given string `arg`
- * will be the argument for that option. If the given `arg` string is NULL, an 
- * empty string is returned. The `arg` string will always be placed in quotes. 
- * Make sure to escape all quotes in `arg`, or you will get unexpected results.
- * The returned string is dynamically allocated, please free it at some point.
- */
-char *optstr(char o, const char *arg, int space)
-{
-	char *str = NULL;
-
-	if (arg)
-	{
-		size_t len = strlen(arg) + 6;
-		str = malloc(len);
-		snprintf(str, len, "-%c%s\"%s\"", o, (space ? " " : ""), arg);
-	}
-	else
-	{
-		str = malloc(1);
-		str[0] = '\0';
-	}
-	return str;
-}
-
 /*
  * Concatenates the given directory, file name and file extension strings
  * to a complete path. The fileext argument is optional, it can be set to NULL.
@@ -228,6 +148,264 @@ char *config_path(const char *filename, const char *dirname)
 	return cfg_path;
 }
 
+/*
+ * Returns the number of bytes taken up by the first `chars` UTF-8 encoded 
+ * characters of `str`, looking at no more than `len` bytes. Continuation 
+ * bytes (10xxxxxx) are counted towards the character they continue.
+ */
+size_t utf8_bytes(const char *str, size_t len, size_t chars)
+{
+	size_t i = 0;
+	for (; i < len; ++i)
+	{
+		if ((str[i] & 0xC0) != 0x80 && chars-- == 0)
+		{
+			break;
+		}
+	}
+	return i;
+}
+
+/*
+ * Multiplies `a` and `b` to a 128 bit result and folds it back into 64 bits
+ * by XOR'ing the upper and lower half; the mixing step of wyhash.
+ */
+static uint64_t hash_mix(uint64_t a, uint64_t b)
+{
+	__uint128_t r = (__uint128_t) a * b;
+	return (uint64_t) r ^ (uint64_t) (r >> 64);
+}
+
+/*
+ * Returns a 64 bit fingerprint of the first `len` bytes of `str`, using the 
+ * given `seed`. This is a simplified wyhash: fast and well distributed, but 
+ * not meant to withstand deliberate collisions. Good for change detection.
+ */
+uint64_t hash(const char *str, size_t len, uint64_t seed)
+{
+	const uint64_t p0 = 0xa0761d6478bd642full;
+	const uint64_t p1 = 0xe7037ed1a0b428dbull;
+	const uint64_t p2 = 0x8ebc6af09c88c6e3ull;
+
+	uint64_t a, b;
+	size_t left = len;
+	seed ^= p0;
+
+	// Mix in the input 16 bytes at a time, memcpy() avoids unaligned reads
+	for (; left > 16; left -= 16, str += 16)
+	{
+		memcpy(&a, str, 8);
+		memcpy(&b, str + 8, 8);
+		seed = hash_mix(a ^ p1, b ^ seed);
+	}
+
+	// Zero-pad the remaining (up to 16) bytes
+	unsigned char tail[16] = { 0 };
+	memcpy(tail, str, left);
+	memcpy(&a, tail, 8);
+	memcpy(&b, tail + 8, 8);
+
+	return hash_mix(p1 ^ len, hash_mix(a ^ p1, b ^ seed) ^ p2);
+}
+
+/*
+ * Makes sure there is room for at least `extra` more bytes (plus the null 
+ * terminator) in the string buffer `sb`, growing it if need be. The buffer 
+ * at least doubles in size every time it has to grow, so that appending to 
+ * it is linear overall, and it never shrinks, so that a buffer that is being
+ * reset and reused will stop allocating once it has seen its largest string.
+ * Returns 0 on success, -1 on error, in which case `sb` is left untouched.
+ */
+int strbuf_grow(strbuf_s *sb, size_t extra)
+{
+	size_t need = sb->len + extra + 1;
+	if (need <= sb->size)
+	{
+		return 0;
+	}
+
+	size_t size = sb->size ? sb->size : BUFFER_BLOCK_RESULT;
+	while (size < need)
+	{
+		size *= 2;
+	}
+
+	char *str = realloc(sb->str, size);
+	if (str == NULL)
+	{
+		return -1;
+	}
+
+	sb->str  = str;
+	sb->size = size;
+	return 0;
+}
+
+/*
+ * Empties the string buffer `sb`, without giving up its memory.
+ */
+void strbuf_reset(strbuf_s *sb)
+{
+	sb->len = 0;
+	if (sb->str)
+	{
+		sb->str[0] = '\0';
+	}
+}
+
+/*
+ * Frees the memory of the string buffer `sb` and resets it to an empty one.
+ */
+void strbuf_free(strbuf_s *sb)
+{
+	free(sb->str);
+	*sb = (strbuf_s) { 0 };
+}
+
+/*
+ * Appends the first `len` bytes of `str` to the string buffer `sb`.
+ * Returns 0 on success, -1 on error.
+ */
+int strbuf_append(strbuf_s *sb, const char *str, size_t len)
+{
+	if (strbuf_grow(sb, len) == -1)
+	{
+		return -1;
+	}
+
+	memcpy(sb->str + sb->len, str, len);
+	sb->len += len;
+	sb->str[sb->len] = '\0';
+	return 0;
+}
+
+/*
+ * Appends the null-terminated string `str` to the string buffer `sb`.
+ * Returns 0 on success, -1 on error.
+ */
+int strbuf_puts(strbuf_s *sb, const char *str)
+{
+	return strbuf_append(sb, str, strlen(str));
+}
+
+/*
+ * Appends `n` times the character `c` to the string buffer `sb`.
+ * Returns 0 on success, -1 on error.
+ */
+int strbuf_fill(strbuf_s *sb, char c, size_t n)
+{
+	if (strbuf_grow(sb, n) == -1)
+	{
+		return -1;
+	}
+
+	memset(sb->str + sb->len, c, n);
+	sb->len += n;
+	sb->str[sb->len] = '\0';
+	return 0;
+}
+
+/*
+ * Appends a string formatted like with printf() to the string buffer `sb`.
+ * Returns 0 on success, -1 on error.
+ */
+int strbuf_printf(strbuf_s *sb, const char *fmt, ...)
+{
+	va_list args;
+	va_start(args, fmt);
+	int len = vsnprintf(NULL, 0, fmt, args);
+	va_end(args);
+
+	if (len < 0 || strbuf_grow(sb, len) == -1)
+	{
+		return -1;
+	}
+
+	va_start(args, fmt);
+	vsnprintf(sb->str + sb->len, len + 1, fmt, args);
+	va_end(args);
+
+	sb->len += len;
+	return 0;
+}
+
+/*
+ * Appends the first `len` bytes of `str` to the string buffer `sb`, with 
+ * every occurence of the character `e` doubled, so that lemonbar shows it 
+ * literally. Returns the number of inserted characters on success, -1 on 
+ * error.
+ */
+int strbuf_escape(strbuf_s *sb, const char *str, size_t len, const char e)
+{
+	// Most strings don't contain `e` at all, those we copy in one go;
+	// memchr() is vectorized (and dispatched to the best variant for the
+	// CPU at hand) by the C library, so this is as fast as it gets
+	const char *hit = memchr(str, e, len);
+	if (hit == NULL)
+	{
+		return strbuf_append(sb, str, len);
+	}
+
+	const char *end = str + len;
+	int n = 0;
+
+	// Copy the runs in between two `e`, including the first `e` each, 
+	// then start the next run at that same `e`, which doubles it
+	do
+	{
+		if (strbuf_append(sb, str, hit - str + 1) == -1)
+		{
+			return -1;
+		}
+		str = hit;
+		++n;
+	}
+	while ((hit = memchr(str + 1, e, end - str - 1)) != NULL);
+
+	return strbuf_append(sb, str, end - str) == -1 ? -1 : n;
+}
+
+/*
+ * Appends the first `len` bytes of `str` to the string buffer `sb`, escaped 
+ * so that they can be placed within the quotes of a JSON string.
+ * Returns 0 on success, -1 on error.
+ */
+int strbuf_json(strbuf_s *sb, const char *str, size_t len)
+{
+	const char *run = str;
+	const char *end = str + len;
+	for (; str < end; ++str)
+	{
+		unsigned char c = *str;
+		if (c >= 0x20 && c != '"' && c != '\\')
+		{
+			continue;
+		}
+
+		// Copy what we have so far, then the escaped character
+		if (strbuf_append(sb, run, str - run) == -1)
+		{
+			return -1;
+		}
+		run = str + 1;
+
+		int res = 0;
+		switch (c)
+		{
+			case '"':  res = strbuf_append(sb, "\\\"", 2); break;
+			case '\\': res = strbuf_append(sb, "\\\\", 2); break;
+			case '\n': res = strbuf_append(sb, "\\n", 2);  break;
+			case '\t': res = strbuf_append(sb, "\\t", 2);  break;
+			default:   res = strbuf_printf(sb, "\\u%04x", c);
+		}
+		if (res == -1)
+		{
+			return -1;
+		}
+	}
+	return strbuf_append(sb, run, end - run);
+}
+
 /*
  * Returns the seconds that have passed since an unspecified starting point,
  * (see CLOCK_MONOTONIC), in seconds, as a floating point number.
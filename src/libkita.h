@@ -3,6 +3,7 @@
 
 #include <stdio.h>  // _IONBF, _IOLBF, _IOFBF
 #include <unistd.h> // STDOUT_FILENO, STDIN_FILENO, STDERR_FILENO
+#include <sys/uio.h> // struct iovec, writev()
 
 ////////////////////////////////////////////////////////////////////////////////
 //                                                                            //
@@ -100,15 +101,26 @@ typedef struct kita_calls kita_calls_s;
 typedef struct kita_stream kita_stream_s;
 
 typedef void (*kita_call_c)(kita_state_s* s, kita_event_s* e);
+typedef int  (*kita_exec_c)(kita_child_s* c, void* ctx);
 
 struct kita_stream
 {
 	FILE* fp;
 	int   fd;
 
+	char*  buf;               // ring buffer for data read from the stream
+	size_t head;              // index of the first unread byte in buf
+	size_t fill;              // number of unread bytes in buf
+	size_t peek;              // length of the line last handed out by peek
+	size_t max;               // max length of lines handed out, 0 for no limit
+	signed char last;         // only read last line? -1: see KITA_OPT_LAST_LINE
+
 	kita_ios_type_e ios_type;
 	kita_buf_type_e buf_type;
 	unsigned registered : 1;  // child registered with epoll? TODO do we need this?
+	unsigned eof : 1;         // read() has reported end of file
+	unsigned trunc : 1;       // line last handed out by peek was cut short
+	unsigned drop : 1;        // discarding the rest of an overlong line
 };
 
 struct kita_child
@@ -122,6 +134,9 @@ struct kita_child
 
 	kita_state_s* state;     // tracking state, if any
 
+	kita_exec_c exec;        // called in the child process, before exec
+	void* exec_ctx;          // user data for exec
+
 	void* ctx;               // user data
 };
 
@@ -160,6 +175,7 @@ int kita_set_callback(kita_state_s* s, kita_evt_type_e type, kita_call_c cb);
 // Main flow control
 int kita_loop(kita_state_s* s);
 int kita_tick(kita_state_s* s, int timeout);
+int kita_wake_on_exit(kita_state_s* s);
 
 // Children: creating, deleting, registering
 kita_child_s* kita_child_new(const char* cmd, int in, int out, int err);
@@ -170,15 +186,23 @@ void kita_child_free(kita_child_s** c); // TODO ?
 
 // Children: setting and getting options
 int           kita_child_set_buf_type(kita_child_s* c, kita_ios_type_e ios, kita_buf_type_e buf);
+int           kita_child_set_max_line(kita_child_s* c, kita_ios_type_e ios, size_t max);
+int           kita_child_set_last_line(kita_child_s* c, kita_ios_type_e ios, int last);
+int           kita_child_set_blocking(kita_child_s* c, kita_ios_type_e ios, int blocking);
 void          kita_child_set_context(kita_child_s* c, void *ctx);
 void*         kita_child_get_context(kita_child_s* c);
 void          kita_child_set_arg(kita_child_s* c, char* arg);
+void          kita_child_set_exec(kita_child_s* c, kita_exec_c cb, void* ctx);
 char*         kita_child_get_arg(kita_child_s* c);
 kita_state_s* kita_child_get_state(kita_child_s* c);
 
 // Children: opening, reading, writing, killing
 int   kita_child_feed(kita_child_s* c, const char* str);
+ssize_t kita_child_feedv(kita_child_s* c, const struct iovec* iov, int cnt);
 char* kita_child_read(kita_child_s* c, kita_ios_type_e n);
+const char* kita_child_peek(kita_child_s* c, kita_ios_type_e n, size_t* len);
+int   kita_child_consume(kita_child_s* c, kita_ios_type_e n);
+int   kita_child_is_truncated(kita_child_s* c, kita_ios_type_e n);
 int   kita_child_open(kita_child_s* c);
 int   kita_child_close(kita_child_s* c); 
 int   kita_child_reap(kita_child_s* c);
@@ -222,6 +246,7 @@ void* kita_get_context(kita_state_s* s);
 #include <sys/types.h> // pid_t
 #include <sys/wait.h>  // waitpid()
 #include <sys/ioctl.h> // ioctl(), FIONREAD
+#include <signal.h>    // sigaction(), sigprocmask(), ...
 #include "libkita.h"
 
 static volatile int running;   // Main loop control 
@@ -245,13 +270,15 @@ libkita_empty(const char *str)
  * If successful, the process id of the new process is being returned and the 
  * given FILE pointers are set to streams that correspond to pipes for reading 
  * and writing to the child process, accordingly. Hand in NULL for pipes that
- * should not be used. On error, -1 is returned. Note that the child process 
+ * should not be used. If `child` has an exec callback, it is called in the 
+ * child process right before the command is executed; if it returns -1, the 
+ * command is not executed. On error, -1 is returned. Note that the child process 
  * might have failed to execute the given `cmd` (and therefore ended exection); 
  * the return value of this function only indicates whether the child process 
  * was successfully forked or not.
  */
 static pid_t
-libkita_popen(const char *cmd, FILE **in, FILE **out, FILE **err)
+libkita_popen(const char *cmd, FILE **in, FILE **out, FILE **err, kita_child_s *child)
 {
 	if (!cmd || !strlen(cmd))
 	{
@@ -311,6 +338,18 @@ libkita_popen(const char *cmd, FILE **in, FILE **out, FILE **err)
 			close(pipe_stderr[0]); // child doesn't need read end
 		}
 
+		// see kita_wake_on_exit(); our command shouldn't inherit that
+		sigset_t chld;
+		sigemptyset(&chld);
+		sigaddset(&chld, SIGCHLD);
+		sigprocmask(SIG_UNBLOCK, &chld, NULL);
+
+		// let the user prepare the child (environment, cgroup, ...)
+		if (child->exec && child->exec(child, child->exec_ctx) == -1)
+		{
+			_exit(-1);
+		}
+
 		wordexp_t p;
 		if (wordexp(cmd, &p, 0) != 0)
 		{
@@ -356,6 +395,260 @@ libkita_fd_data_avail(int fd)
 	return ioctl(fd, FIONREAD, &bytes) == -1 ? -1 : bytes;
 }
 
+/*
+ * Reverses the bytes in `buf` from index `from` up to, excluding, index `to`.
+ */
+static void
+libkita_reverse(char *buf, size_t from, size_t to)
+{
+	char c;
+	while (from + 1 < to)
+	{
+		c = buf[from];
+		buf[from++] = buf[--to];
+		buf[to] = c;
+	}
+}
+
+/*
+ * Empties the stream's ring buffer, discarding all unread data, if any.
+ */
+static void
+libkita_stream_reset(kita_stream_s *stream)
+{
+	stream->head = 0;
+	stream->fill = 0;
+	stream->peek = 0;
+	stream->eof  = 0;
+	stream->trunc = 0;
+	stream->drop  = 0;
+}
+
+/*
+ * Marks the first `len` unread bytes in the stream's ring buffer as read.
+ */
+static void
+libkita_stream_consume(kita_stream_s *stream, size_t len)
+{
+	len = len > stream->fill ? stream->fill : len;
+	stream->head = (stream->head + len) % KITA_BUFFER_SIZE;
+	stream->fill -= len;
+
+	// Starting over at the beginning makes wrapping lines less likely
+	if (stream->fill == 0)
+	{
+		stream->head = 0;
+	}
+}
+
+/*
+ * Looks for a newline in the stream's ring buffer, starting `off` bytes after 
+ * the first unread byte. Returns the length of the data up to and including 
+ * the newline, or 0 if there is no newline.
+ */
+static size_t
+libkita_stream_find(kita_stream_s *stream, size_t off)
+{
+	if (off >= stream->fill)
+	{
+		return 0;
+	}
+
+	size_t cap   = KITA_BUFFER_SIZE;
+	size_t start = (stream->head + off) % cap;
+	size_t avail = stream->fill - off;
+	size_t first = (start + avail > cap) ? cap - start : avail;
+
+	// Search up to the end of the buffer, then, if the data wraps, from the start
+	char *nl = memchr(stream->buf + start, '\n', first);
+	if (nl)
+	{
+		return (nl - (stream->buf + start)) + 1;
+	}
+	if (first < avail)
+	{
+		nl = memchr(stream->buf, '\n', avail - first);
+		if (nl)
+		{
+			return first + (nl - stream->buf) + 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Discards unread data up to and including the next newline, as the rest of a 
+ * line that has been cut short. If there is no newline, all data is discarded 
+ * and we keep discarding with the next read.
+ */
+static void
+libkita_stream_drop(kita_stream_s *stream)
+{
+	size_t len = libkita_stream_find(stream, 0);
+	libkita_stream_consume(stream, len ? len : stream->fill);
+	stream->drop = (len == 0);
+}
+
+/*
+ * Reads from the stream's file descriptor into its ring buffer, until read() 
+ * reports EAGAIN or end of file, or until the ring buffer is full. Uses read() 
+ * instead of stdio, as stdio keeps its own buffer that we can't inspect.
+ * Returns the number of bytes read or -1 on error.
+ */
+static ssize_t
+libkita_stream_fill(kita_stream_s *stream)
+{
+	if (stream->buf == NULL || stream->fd < 0)
+	{
+		return -1;
+	}
+
+	size_t  cap   = KITA_BUFFER_SIZE;
+	ssize_t total = 0;
+
+	while (stream->fill < cap)
+	{
+		// Free space starts after the unread data and either ends at the 
+		// end of the buffer or, if the unread data wraps around, its start
+		size_t tail = (stream->head + stream->fill) % cap;
+		size_t room = (tail >= stream->head) ? cap - tail : stream->head - tail;
+
+		ssize_t n = read(stream->fd, stream->buf + tail, room);
+		if (n > 0)
+		{
+			stream->fill += n;
+			total += n;
+			if (stream->drop)
+			{
+				libkita_stream_drop(stream);
+			}
+			continue;
+		}
+		if (n == 0)
+		{
+			stream->eof = 1;
+			break;
+		}
+		if (errno == EINTR)
+		{
+			continue;
+		}
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+		{
+			break;
+		}
+		return -1;
+	}
+	return total;
+}
+
+/*
+ * Looks for a complete line in the stream's ring buffer, starting `off` bytes 
+ * after the first unread byte. Returns the length of the line, including the 
+ * newline, or 0 if there is no complete line. If end of file has been reached 
+ * or the ring buffer is full, trailing data without a newline counts as line.
+ */
+static size_t
+libkita_stream_frame(kita_stream_s *stream, size_t off)
+{
+	if (off >= stream->fill)
+	{
+		return 0;
+	}
+
+	size_t len = libkita_stream_find(stream, off);
+	if (len)
+	{
+		return len;
+	}
+
+	size_t avail = stream->fill - off;
+	return (stream->eof || stream->fill == KITA_BUFFER_SIZE) ? avail : 0;
+}
+
+/*
+ * Marks the line last handed out by libkita_stream_peek() as read. If that 
+ * line was cut short and its remainder has yet to arrive, that remainder will 
+ * be discarded as it comes in.
+ */
+static void
+libkita_stream_release(kita_stream_s *stream)
+{
+	if (stream->peek == 0)
+	{
+		return;
+	}
+
+	size_t last = (stream->head + stream->peek - 1) % KITA_BUFFER_SIZE;
+	int split = stream->buf[last] != '\n';
+
+	libkita_stream_consume(stream, stream->peek);
+	stream->peek = 0;
+
+	if (stream->trunc && split && !stream->eof)
+	{
+		stream->drop = 1;
+	}
+}
+
+/*
+ * Makes sure the first `len` unread bytes are contiguous in the ring buffer, 
+ * by rotating the buffer's content so that the unread data starts at index 0.
+ * This only needs to happen if a line wraps around the end of the buffer.
+ * Returns a pointer to the first unread byte.
+ */
+static char*
+libkita_stream_align(kita_stream_s *stream, size_t len)
+{
+	size_t cap = KITA_BUFFER_SIZE;
+	if (stream->head + len > cap)
+	{
+		// Rotating left by `head` via three reversals, no copy needed
+		libkita_reverse(stream->buf, 0, stream->head);
+		libkita_reverse(stream->buf, stream->head, cap);
+		libkita_reverse(stream->buf, 0, cap);
+		stream->head = 0;
+	}
+	return stream->buf + stream->head;
+}
+
+/*
+ * Reads all available data into the stream's ring buffer, then discards all 
+ * complete lines but the last one. Returns the number of discarded lines.
+ */
+static size_t
+libkita_stream_skip(kita_stream_s *stream)
+{
+	size_t skipped = 0;
+	size_t len = 0;
+
+	libkita_stream_fill(stream);
+	do
+	{
+		// Drop the next line for as long as another complete line follows
+		while ((len = libkita_stream_frame(stream, 0)) &&
+				libkita_stream_frame(stream, len))
+		{
+			libkita_stream_consume(stream, len);
+			++skipped;
+		}
+	}
+	while (libkita_stream_fill(stream) > 0);
+
+	return skipped;
+}
+
+/*
+ * Returns the number of bytes available for reading from the given stream, 
+ * which includes data in its ring buffer as well as data in the pipe.
+ */
+static int
+libkita_stream_data_avail(kita_stream_s *stream)
+{
+	int bytes = libkita_fd_data_avail(stream->fd);
+	return (bytes == -1 ? 0 : bytes) + stream->fill;
+}
+
 static int
 libkita_child_has_fd(kita_child_s *child, int fd)
 {
@@ -540,6 +833,7 @@ libkita_stream_close(kita_stream_s *stream)
 	fclose(stream->fp);
 	stream->fp = NULL;
 	stream->fd = -1;
+	libkita_stream_reset(stream);
 	return 0;
 }
 
@@ -564,6 +858,18 @@ libkita_stream_new(kita_ios_type_e ios)
 	// set stream type and stream buffer type
 	stream->ios_type = ios;
 	stream->buf_type = (ios == KITA_IOS_ERR) ? KITA_BUF_NONE : KITA_BUF_LINE;
+	stream->last = -1;
+
+	// streams we read from get a ring buffer (plus room for a terminator)
+	if (ios != KITA_IOS_IN)
+	{
+		stream->buf = malloc(KITA_BUFFER_SIZE + 1);
+		if (stream->buf == NULL)
+		{
+			free(stream);
+			return NULL;
+		}
+	}
 
 	return stream;
 }
@@ -637,7 +943,8 @@ libkita_child_open(kita_child_s *child)
 			cmd ? cmd : child->cmd, 
 			child->io[KITA_IOS_IN]  ? &child->io[KITA_IOS_IN]->fp  : NULL,
 			child->io[KITA_IOS_OUT] ? &child->io[KITA_IOS_OUT]->fp : NULL,
-		        child->io[KITA_IOS_ERR] ? &child->io[KITA_IOS_ERR]->fp : NULL);
+		        child->io[KITA_IOS_ERR] ? &child->io[KITA_IOS_ERR]->fp : NULL,
+			child);
 	free(cmd);
 
 	// Check if that worked
@@ -654,6 +961,7 @@ libkita_child_open(kita_child_s *child)
 		if (child->io[i] && child->io[i]->fp)
 		{
 			child->io[i]->fd = fileno(child->io[i]->fp);
+			libkita_stream_reset(child->io[i]);
 			libkita_stream_set_buf_type(child->io[i], child->io[i]->buf_type);
 			// TODO wouldn't it be best to set non-blocking right here?
 			//libkita_stream_set_blocking(child->io[i], 0);
@@ -816,6 +1124,49 @@ libkita_child_status(kita_child_s *child)
 	return 0;
 }
 
+/*
+ * Reads all data that is left in the given stream's pipe into its ring buffer 
+ * and dispatches a READOK event if there is unread data. This makes sure that 
+ * the output of a child that has exited doesn't get lost when we close the 
+ * stream before we got to process the child's last epoll event.
+ */
+static void
+libkita_stream_flush(kita_state_s *state, kita_child_s *child, kita_ios_type_e ios)
+{
+	kita_stream_s *stream = child->io[ios];
+	if (stream == NULL || stream->fp == NULL || stream->buf == NULL)
+	{
+		return;
+	}
+
+	libkita_stream_fill(stream);
+	if (stream->fill == 0)
+	{
+		return;
+	}
+
+	// the child is gone, so whatever partial line is left is its last
+	stream->eof = 1;
+
+	kita_event_s event = { 0 };
+	event.child = child;
+	event.type  = KITA_EVT_CHILD_READOK;
+	event.ios   = ios;
+	event.fd    = stream->fd;
+	event.size  = stream->fill;
+	libkita_dispatch_event(state, &event);
+}
+
+/*
+ * Flushes the child's stdout and stderr streams, see libkita_stream_flush().
+ */
+static void
+libkita_child_flush(kita_state_s *state, kita_child_s *child)
+{
+	libkita_stream_flush(state, child, KITA_IOS_OUT);
+	libkita_stream_flush(state, child, KITA_IOS_ERR);
+}
+
 /*
  * Uses waitpid() to identify children that have died. Dead children will be 
  * closed (by closing all of their streams) and their PID will be reset to 0. 
@@ -841,6 +1192,9 @@ libkita_reap(kita_state_s *state)
 			// remember the child's waitpid status
 			child->status = status;
 
+			// read what the child has left in its pipes, if anything
+			libkita_child_flush(state, child);
+
 			// remove epoll events
 			libkita_child_rem_events(state, child);
 
@@ -943,7 +1297,7 @@ libkita_handle_event(kita_state_s *state, struct epoll_event *epev)
 	if(epev->events & EPOLLIN)
 	{
 		event.type = KITA_EVT_CHILD_READOK; 
-		event.size = libkita_fd_data_avail(event.fd);
+		event.size = libkita_stream_data_avail(child->io[event.ios]);
 		libkita_dispatch_event(state, &event);
 		return 0;
 	}
@@ -960,6 +1314,9 @@ libkita_handle_event(kita_state_s *state, struct epoll_event *epev)
 	// EPOLLHUP:   Unexpected hangup on socket 
 	if (epev->events & EPOLLRDHUP || epev->events & EPOLLHUP)
 	{
+		// read what's left in the pipe before we close it
+		libkita_stream_flush(state, child, event.ios);
+
 		// dispatch hangup event
 		event.type = KITA_EVT_CHILD_HANGUP;
 		libkita_dispatch_event(state, &event);
@@ -1013,90 +1370,125 @@ libkita_stream_free(kita_stream_s** stream)
 		libkita_stream_close(*stream);
 	}
 
+	free((*stream)->buf);
 	free(*stream);
 	*stream = NULL;
 }
 
 /*
- * TODO - currently we only ever get the last line, regardles of `last`
- *      - error handling for getline() (EOF, error) 
+ * Finds the next complete line in the stream and returns a pointer to it, 
+ * without copying or consuming it; the line is not null-terminated. Its length
+ * will be written to `len`. If `last` is set, all complete lines but the last 
+ * one will be discarded. If `no_nl` is set, `len` won't include the newline.
+ * The pointer is valid until the next call to any of the stream's functions.
+ * Returns NULL if no complete line is available (yet).
  */
-static char*
-libkita_stream_read_line(kita_stream_s *stream, int last, int no_nl)
+static const char*
+libkita_stream_peek(kita_stream_s *stream, int last, int no_nl, size_t *len)
 {
-	if (stream->fp == NULL)
+	if (stream->buf == NULL)
 	{
 		return NULL;
 	}
 
-	// TODO I thought getline() would be the perfect tool here, as it even 
-	//      allocates a suitable buffer by itself. however, for whatever 
-	//      reason, getline() returns -1 with EAGAIN _after_ the first line 
-	//      (for the second, third, ... line) - why does it fail to read?! 
-	//      data keeps building up...
-	/*
-	  [...] getline() approach here
-	*/
-
-	// TODO there is a bug in here. imagine this scenario: despite being
-	//      line buffered, the file descriptor has _multiple_ lines ready 
-	//      to be read (yes, this does happen). in this case, while we do 
-	//      seem to get the correct amount of data waiting, we fail to 
-	//      read all of it, because fgets() stops at a newline - and there 
-	//      are now two (or more) newlines in the data to be read.
-	/*
-	size_t len = libkita_fd_data_avail(stream->fd) + 1;
-	char*  buf = malloc(len * sizeof(char));
-
-	fgets(buf, len, stream->fp);
-	*/
-
-	size_t num_lines = 0;
-	size_t len = libkita_fd_data_avail(stream->fd) + 2;
-	char*  buf = malloc(len * sizeof(char));
-	
-	// fgets() - reads until a newline ('\n') or EOF (end of file)
-	//         - returns NULL on error or when EOF occurs
-	while (fgets(buf, len, stream->fp) != NULL)
+	if (last)
 	{
-		++num_lines;
+		libkita_stream_skip(stream);
+	}
+	else
+	{
+		libkita_stream_fill(stream);
 	}
 
-	// remove trailing newline, if requested
-	if (no_nl)
+	stream->peek = libkita_stream_frame(stream, 0);
+	if (stream->peek == 0)
 	{
-		buf[strcspn(buf, "\n")] = 0;
+		return NULL;
 	}
 
-	// return the last line we read
-	return buf;
+	char *line = libkita_stream_align(stream, stream->peek);
+	int    nl  = line[stream->peek-1] == '\n';
+	size_t cut = stream->peek - nl;
+
+	// Lines exceeding the max length get cut short, without the newline,
+	// and so do lines that don't even fit into the ring buffer
+	int full = !nl && !stream->eof && stream->peek == KITA_BUFFER_SIZE;
+	stream->trunc = (stream->max && cut > stream->max) || full;
+	if (stream->trunc)
+	{
+		*len = (stream->max && cut > stream->max) ? stream->max : cut;
+		return line;
+	}
+
+	*len = (no_nl && nl) ? cut : stream->peek;
+	return line;
 }
 
 /*
- * TODO - what if libkita_fd_data_avail() comes back as -1 (can't determine)?
- *      - what if fread() encounters EOF (feof()) or an error (ferror())?
+ * Reads the next complete line from the stream into a newly allocated string,
+ * which the caller has to free. See libkita_stream_peek() for `last`, `no_nl`.
+ * Lines that don't fit into the stream's ring buffer will be cut short.
+ * Returns NULL if no complete line is available (yet).
  */
 static char*
-libkita_stream_read_data(kita_stream_s *stream)
+libkita_stream_read_line(kita_stream_s *stream, int last, int no_nl)
 {
-	if (stream->fd < 2)
+	size_t len = 0;
+	const char *line = libkita_stream_peek(stream, last, no_nl, &len);
+	if (line == NULL)
 	{
 		return NULL;
 	}
-	if (stream->fp == NULL)
+
+	char *buf = malloc(len + 1);
+	if (buf == NULL)
+	{
+		return NULL;
+	}
+
+	memcpy(buf, line, len);
+	buf[len] = '\0';
+	libkita_stream_release(stream);
+
+	return buf;
+}
+
+/*
+ * Reads all available data from the stream into a newly allocated string, 
+ * which the caller has to free. Returns NULL if no data was available.
+ */
+static char*
+libkita_stream_read_data(kita_stream_s *stream)
+{
+	if (stream->buf == NULL)
 	{
 		return NULL;
 	}
 
-	// TODO I believe there to be a bug here (race condition), where there
-	//      could be new data already arriving between the calls to 
-	//      libkita_fd_data_avail() and fgets(), effectively making us 
-	//      not read all the data that is available, which then gets us 
-	//      into some unholy stuck mess!
-	size_t len = libkita_fd_data_avail(stream->fd) + 2;
-	char*  buf = malloc(len * sizeof(char));
+	char  *buf = NULL;
+	size_t len = 0;
+
+	// Keep going until the pipe is empty, as the ring buffer might fill up
+	while (libkita_stream_fill(stream) > 0 || stream->fill)
+	{
+		char *tmp = realloc(buf, len + stream->fill + 1);
+		if (tmp == NULL)
+		{
+			break;
+		}
+		buf = tmp;
+
+		char *data = libkita_stream_align(stream, stream->fill);
+		memcpy(buf + len, data, stream->fill);
+		len += stream->fill;
+		libkita_stream_consume(stream, stream->fill);
+	}
 
-	fread(buf, len, 1, stream->fp);
+	stream->peek = 0;
+	if (buf)
+	{
+		buf[len] = '\0';
+	}
 	return buf;
 }
 
@@ -1130,16 +1522,11 @@ libkita_poll(kita_state_s *s, int timeout)
 	// the signals that are ignored by default. For a list of signals:
 	// https://en.wikipedia.org/wiki/Signal_(IPC)
 	
-	sigset_t sigset;
-	sigemptyset(&sigset);
-	sigaddset(&sigset, SIGCHLD);  // default: ignore
-	sigaddset(&sigset, SIGCONT);  // default: continue execution
-	sigaddset(&sigset, SIGURG);   // default: ignore
-	sigaddset(&sigset, SIGWINCH); // default: ignore
+	// The set of signals is put together by kita_init().
 
 	// timeout = -1 -> block indefinitely, until events available
 	// timeout =  0 -> return immediately, even if no events available
-	int num_events = epoll_pwait(s->epfd, &epev, 1, timeout, &sigset);
+	int num_events = epoll_pwait(s->epfd, &epev, 1, timeout, &s->sigset);
 
 	// An error has occured
 	if (num_events == -1)
@@ -1278,6 +1665,20 @@ kita_child_close(kita_child_s *child)
 	return libkita_child_close(child) > 0 ? 0 : -1;
 }
 
+/*
+ * Makes the given stream of the child blocking (1) or non-blocking (0).
+ * The stream needs to be open. Returns 0 on success, -1 on error.
+ */
+int
+kita_child_set_blocking(kita_child_s *child, kita_ios_type_e ios, int blocking)
+{
+	if (child->io[ios] == NULL)
+	{
+		return -1;
+	}
+	return libkita_stream_set_blocking(child->io[ios], blocking);
+}
+
 /*
  * Set the child's stream, specified by `ios`, to the buffer type specified
  * via `buf`. Returns 0 on success, -1 on error.
@@ -1307,6 +1708,43 @@ kita_child_get_buf_type(kita_child_s *child, kita_ios_type_e ios)
 	return child->io[ios]->buf_type;
 }
 
+/*
+ * Set the max length of lines read from the child's stream specified by `ios`.
+ * Longer lines will be cut short and the rest of them will be discarded as it
+ * is being read. Lines are always limited by the size of the stream's buffer,
+ * KITA_BUFFER_SIZE, and cut short the same way if they exceed it. A `max` of 
+ * 0 means no limit other than that. Returns 0 on success, -1 on error.
+ */
+int
+kita_child_set_max_line(kita_child_s *child, kita_ios_type_e ios, size_t max)
+{
+	if (ios == KITA_IOS_IN || child->io[ios] == NULL)
+	{
+		return -1;
+	}
+
+	child->io[ios]->max = max;
+	return 0;
+}
+
+/*
+ * Set whether only the last line should be read from the child's stream 
+ * specified by `ios`, dropping all lines before it, overriding the state's 
+ * KITA_OPT_LAST_LINE option for this stream. A `last` of -1 removes the 
+ * override again. Returns 0 on success, -1 on error.
+ */
+int
+kita_child_set_last_line(kita_child_s *child, kita_ios_type_e ios, int last)
+{
+	if (ios == KITA_IOS_IN || child->io[ios] == NULL)
+	{
+		return -1;
+	}
+
+	child->io[ios]->last = last < 0 ? -1 : !!last;
+	return 0;
+}
+
 /*
  * Save a reference to `arg`, which will be used as additional argument 
  * when opening or running this child. Use `NULL` to clear the argument.
@@ -1317,6 +1755,19 @@ kita_child_set_arg(kita_child_s *child, char *arg)
 	child->arg = arg;
 }
 
+/*
+ * Set a function that will be called in the child process, after it has 
+ * been forked, but before the command is executed, whenever the child is
+ * opened; `ctx` will be handed to it. If the function returns -1, the child
+ * process exits without executing the command. Use `NULL` to clear it.
+ */
+void
+kita_child_set_exec(kita_child_s *child, kita_exec_c cb, void *ctx)
+{
+	child->exec = cb;
+	child->exec_ctx = ctx;
+}
+
 char*
 kita_child_get_arg(kita_child_s *child)
 {
@@ -1426,6 +1877,21 @@ kita_child_term(kita_child_s *child)
 	return kill(child->pid, SIGTERM);
 }
 
+/*
+ * Returns whether only the last line should be read from the given stream of 
+ * the child, which is the stream's own setting, if it has been set via 
+ * kita_child_set_last_line(), or the KITA_OPT_LAST_LINE option otherwise.
+ */
+static int
+libkita_child_last_line(kita_child_s *child, kita_ios_type_e ios)
+{
+	if (child->io[ios]->last >= 0)
+	{
+		return child->io[ios]->last;
+	}
+	return child->state ? kita_get_option(child->state, KITA_OPT_LAST_LINE) : 0;
+}
+
 /*
  * Attempts to read from the child's stream specified by `ios` (should be one 
  * of KITA_IOS_OUT, KITA_IOS_ERR) and returns the read bytes as a dynamically
@@ -1462,12 +1928,79 @@ kita_child_read(kita_child_s *child, kita_ios_type_e ios)
 	//    and fgets() or getline() for line buffered streams
 
 	kita_state_s* state = child->state;
-	int last = state ? kita_get_option(state, KITA_OPT_LAST_LINE) : 0;
+	int last = libkita_child_last_line(child, ios);
 	int nonl = state ? kita_get_option(state, KITA_OPT_NO_NEWLINE) : 0;
 
 	return libkita_stream_read(child->io[ios], last, nonl);
 }
 
+/*
+ * Returns a pointer to the next line of the child's output on the given stream
+ * (respecting the KITA_OPT_LAST_LINE and KITA_OPT_NO_NEWLINE options) and 
+ * writes its length to `len`. The line is not null-terminated and stays in 
+ * the stream's buffer until it is consumed via kita_child_consume(). The 
+ * pointer is only valid until the next read, peek or consume on the stream.
+ * Returns NULL if no complete line is available or on error.
+ */
+const char*
+kita_child_peek(kita_child_s *child, kita_ios_type_e ios, size_t *len)
+{
+	if (ios != KITA_IOS_OUT && ios != KITA_IOS_ERR)
+	{
+		return NULL;
+	}
+
+	if (child->io[ios] == NULL) // no such stream
+	{
+		return NULL;
+	}
+
+	kita_state_s* state = child->state;
+	int last = libkita_child_last_line(child, ios);
+	int nonl = state ? kita_get_option(state, KITA_OPT_NO_NEWLINE) : 0;
+
+	return libkita_stream_peek(child->io[ios], last, nonl, len);
+}
+
+/*
+ * Discards the line last returned by kita_child_peek() for the given stream.
+ * Returns 0 on success, -1 if there was no such line.
+ */
+int
+kita_child_consume(kita_child_s *child, kita_ios_type_e ios)
+{
+	if (ios != KITA_IOS_OUT && ios != KITA_IOS_ERR)
+	{
+		return -1;
+	}
+
+	kita_stream_s *stream = child->io[ios];
+	if (stream == NULL || stream->peek == 0)
+	{
+		return -1;
+	}
+
+	libkita_stream_release(stream);
+	return 0;
+}
+
+/*
+ * Returns 1 if the line last returned by kita_child_peek() for the given 
+ * stream has been cut short because it exceeded the stream's max line length,
+ * see kita_child_set_max_line(). Returns 0 otherwise or on error.
+ */
+int
+kita_child_is_truncated(kita_child_s *child, kita_ios_type_e ios)
+{
+	if (ios != KITA_IOS_OUT && ios != KITA_IOS_ERR)
+	{
+		return 0;
+	}
+
+	kita_stream_s *stream = child->io[ios];
+	return (stream && stream->peek) ? stream->trunc : 0;
+}
+
 /*
  * Writes the given `input` to the child's stdin stream.
  * Returns 0 on success, -1 on error.
@@ -1496,6 +2029,32 @@ kita_child_feed(kita_child_s *child, const char *input)
 	return (fputs(input, child->io[KITA_IOS_IN]->fp) == EOF) ? -1 : 0;
 }
 
+/*
+ * Writes the `cnt` buffers described by `iov` to the child's stdin stream 
+ * with a single writev(), bypassing the stream's FILE buffer; hence, don't 
+ * mix this with kita_child_feed() on the same child. If stdin has been made
+ * non-blocking (see kita_child_set_blocking()), this might write only part 
+ * of the data, or nothing at all, in which case a KITA_EVT_CHILD_FEEDOK event 
+ * will signal when the child is ready for more. Returns the number of bytes 
+ * written (which can be 0), or -1 on error.
+ */
+ssize_t
+kita_child_feedv(kita_child_s *child, const struct iovec *iov, int cnt)
+{
+	// child doesn't have a stdin stream or it isn't open
+	if (child->io[KITA_IOS_IN] == NULL || child->io[KITA_IOS_IN]->fp == NULL)
+	{
+		return -1;
+	}
+
+	ssize_t num = writev(child->io[KITA_IOS_IN]->fd, iov, cnt);
+	if (num == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+	{
+		return 0;
+	}
+	return num;
+}
+
 void
 kita_child_free(kita_child_s** child)
 {
@@ -1662,6 +2221,45 @@ kita_tick(kita_state_s *state, int timeout)
 	return 0; // TODO
 }
 
+static void
+libkita_on_sigchld(int sig)
+{
+	// Nothing to do, we only want epoll_pwait() to be interrupted
+}
+
+/*
+ * Makes kita_tick() return as soon as a child process exits, instead of with
+ * the next event or timeout, so that its REAPED event is dispatched right
+ * away. Children without any streams would otherwise go unnoticed until then.
+ * To do so, SIGCHLD gets a handler and is blocked everywhere but inside of 
+ * epoll_pwait(), so that no exit can slip by between two calls to it; child
+ * processes have it unblocked again before they run their command.
+ * Returns 0 on success, -1 on error.
+ */
+int
+kita_wake_on_exit(kita_state_s *state)
+{
+	struct sigaction sa = { 
+		.sa_handler = libkita_on_sigchld,
+		.sa_flags   = SA_RESTART | SA_NOCLDSTOP
+	};
+	if (sigaction(SIGCHLD, &sa, NULL) == -1)
+	{
+		return -1;
+	}
+
+	sigset_t chld;
+	sigemptyset(&chld);
+	sigaddset(&chld, SIGCHLD);
+	if (sigprocmask(SIG_BLOCK, &chld, NULL) == -1)
+	{
+		return -1;
+	}
+
+	sigdelset(&state->sigset, SIGCHLD);
+	return 0;
+}
+
 // TODO - we need some more condition as to when we quit the loop?
 //      - make the timeout (-1 hardcoded) a parameter of the function?
 //      - also, check the todos within the function
@@ -1727,6 +2325,13 @@ kita_init()
 		return NULL;
 	}
 
+	// Signals that shouldn't interrupt epoll_pwait(), see libkita_poll()
+	sigemptyset(&s->sigset);
+	sigaddset(&s->sigset, SIGCHLD);  // default: ignore
+	sigaddset(&s->sigset, SIGCONT);  // default: continue execution
+	sigaddset(&s->sigset, SIGURG);   // default: ignore
+	sigaddset(&s->sigset, SIGWINCH); // default: ignore
+
 	// Return a pointer to the created state struct
 	return s;
 }
@@ -104,6 +104,31 @@ int lemon_ini_handler(void *data, const char *section, const char *name, const c
 		cfg_set_str(lc, LEMON_OPT_AFFIX_FONT, is_quoted(value) ? unquote(value) : strdup(value));
 		return 1;
 	}
+	if (equals(name, "cgroup"))
+	{
+		cfg_set_str(lc, LEMON_OPT_CGROUP, is_quoted(value) ? unquote(value) : strdup(value));
+		return 1;
+	}
+	if (equals(name, "restart"))
+	{
+		cfg_set_int(lc, LEMON_OPT_RESTART, equals(value, "true"));
+		return 1;
+	}
+	if (equals(name, "log"))
+	{
+		cfg_set_str(lc, LEMON_OPT_LOG, is_quoted(value) ? unquote(value) : strdup(value));
+		return 1;
+	}
+	if (equals(name, "sinks"))
+	{
+		cfg_set_str(lc, LEMON_OPT_SINKS, is_quoted(value) ? unquote(value) : strdup(value));
+		return 1;
+	}
+	if (equals(name, "max-fps"))
+	{
+		cfg_set_float(lc, LEMON_OPT_MAX_FPS, atof(value));
+		return 1;
+	}
 
 	// Unknown section or name
 	return 0;
@@ -286,6 +311,61 @@ int block_ini_handler(void *data, const char *section, const char *name, const c
 		cfg_set_str(bc, BLOCK_OPT_CMD_SDN, is_quoted(value) ? unquote(value) : strdup(value));
 		return 1;
 	}
+	if (equals(name, "cgroup"))
+	{
+		cfg_set_str(bc, BLOCK_OPT_CGROUP, is_quoted(value) ? unquote(value) : strdup(value));
+		return 1;
+	}
+	if (equals(name, "cpu-max"))
+	{
+		cfg_set_str(bc, BLOCK_OPT_CPU_MAX, is_quoted(value) ? unquote(value) : strdup(value));
+		return 1;
+	}
+	if (equals(name, "memory-max"))
+	{
+		cfg_set_str(bc, BLOCK_OPT_MEMORY_MAX, is_quoted(value) ? unquote(value) : strdup(value));
+		return 1;
+	}
+	if (equals(name, "source"))
+	{
+		cfg_set_str(bc, BLOCK_OPT_SOURCE, is_quoted(value) ? unquote(value) : strdup(value));
+		return 1;
+	}
+	if (equals(name, "debounce"))
+	{
+		cfg_set_float(bc, BLOCK_OPT_DEBOUNCE, atof(value));
+		return 1;
+	}
+	if (equals(name, "action-limit"))
+	{
+		cfg_set_int(bc, BLOCK_OPT_ACTION_LIMIT, atoi(value));
+		return 1;
+	}
+	if (equals(name, "max-bytes"))
+	{
+		cfg_set_int(bc, BLOCK_OPT_MAX_BYTES, atoi(value));
+		return 1;
+	}
+	if (equals(name, "max-chars"))
+	{
+		cfg_set_int(bc, BLOCK_OPT_MAX_CHARS, atoi(value));
+		return 1;
+	}
+	if (equals(name, "max-rate"))
+	{
+		cfg_set_float(bc, BLOCK_OPT_MAX_RATE, atof(value));
+		return 1;
+	}
+	if (equals(name, "log"))
+	{
+		cfg_set_int(bc, BLOCK_OPT_LOG, equals(value, "true"));
+		return 1;
+	}
+	if (equals(name, "structured"))
+	{
+		cfg_set_int(bc, BLOCK_OPT_STRUCTURED, equals(value, "true"));
+		return 1;
+	}
 
 	// Unknown section or name
 	return 0;
@@ -0,0 +1,115 @@
+#include <stdio.h>       // snprintf()
+#include <string.h>      // memset()
+#include <limits.h>      // INT_MAX
+#include <fcntl.h>       // O_RDWR, O_CREAT, O_CLOEXEC
+#include <sys/mman.h>    // shm_open(), shm_unlink(), mmap(), munmap()
+#include <sys/syscall.h> // SYS_futex
+#include <linux/futex.h> // FUTEX_WAKE
+
+/*
+ * Creates the shared memory object `name` (for example "/succade", which
+ * ends up as /dev/shm/succade), sizes it to `size` bytes, maps it and sets
+ * up the header for the given number of blocks. An existing object of that
+ * name is taken over. The file descriptor is stored in `fd`.
+ * Returns the mapped header or NULL on error.
+ */
+shm_s *shm_create(const char *name, size_t size, size_t num_blocks, int *fd)
+{
+	*fd = shm_open(name, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (*fd == -1)
+	{
+		return NULL;
+	}
+
+	void *map = MAP_FAILED;
+	if (ftruncate(*fd, size) == 0)
+	{
+		map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, *fd, 0);
+	}
+	if (map == MAP_FAILED)
+	{
+		close(*fd);
+		shm_unlink(name);
+		return NULL;
+	}
+
+	shm_s *shm = map;
+	memset(shm, 0, sizeof(shm_s));
+	shm->version    = SHM_VERSION;
+	shm->size       = size;
+	shm->pid        = getpid();
+	shm->num_blocks = num_blocks;
+
+	// Written last, so readers only ever see a complete header
+	__atomic_store_n(&shm->magic, SHM_MAGIC, __ATOMIC_RELEASE);
+	return shm;
+}
+
+/*
+ * Grows the mapped shared memory object behind `fd` from `size` to at least
+ * `need` bytes, doubling its size, and updates `shm` and `size` accordingly.
+ * The object never shrinks, so readers can keep using their old mapping
+ * until they see the header's size change and remap.
+ * Returns 0 on success, -1 on error, in which case the old mapping remains.
+ */
+int shm_grow(shm_s **shm, size_t *size, size_t need, int fd)
+{
+	size_t grown = *size;
+	while (grown < need)
+	{
+		grown *= 2;
+	}
+	if (grown > UINT32_MAX || ftruncate(fd, grown) == -1)
+	{
+		return -1;
+	}
+
+	void *map = mmap(NULL, grown, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+	{
+		return -1;
+	}
+
+	munmap(*shm, *size);
+	*shm  = map;
+	*size = grown;
+	__atomic_store_n(&(*shm)->size, grown, __ATOMIC_RELEASE);
+	return 0;
+}
+
+/*
+ * Marks the start of an update; the sequence number becomes odd, which tells
+ * readers to retry. The data may only be written after this returns.
+ */
+void shm_begin(shm_s *shm)
+{
+	__atomic_store_n(&shm->seq, shm->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/*
+ * Marks the end of an update; the sequence number becomes even again and
+ * readers that are waiting for it to change (FUTEX_WAIT) are woken up.
+ * Waking doesn't wait for the readers, so they can never hold us up.
+ */
+void shm_end(shm_s *shm)
+{
+	__atomic_store_n(&shm->seq, shm->seq + 1, __ATOMIC_RELEASE);
+	syscall(SYS_futex, &shm->seq, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+/*
+ * Tells readers we're gone by clearing the PID and waking them up, then
+ * unmaps and removes the shared memory object `name`. Readers that still
+ * have it mapped can keep reading the last frame.
+ */
+void shm_close(shm_s *shm, size_t size, int fd, const char *name)
+{
+	shm_begin(shm);
+	shm->pid = 0;
+	shm_end(shm);
+
+	munmap(shm, size);
+	close(fd);
+	shm_unlink(name);
+}
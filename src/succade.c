@@ -5,16 +5,21 @@
 #include <string.h>    // strlen(), strcmp(), ...
 #include <signal.h>    // sigaction(), ... 
 #include <float.h>     // DBL_MAX
+#include <fcntl.h>     // open(), O_WRONLY, O_APPEND, O_NONBLOCK, ...
+#include <sys/stat.h>  // fstat(), S_ISREG()
 #include "ini.h"       // https://github.com/benhoyt/inih
 #include "cfg.h"
 #include "libkita.h"
 #include "succade.h"   // defines, structs, all that stuff
 #include "options.c"   // Command line args/options parsing
 #include "helpers.c"   // Helper functions, mostly for strings
+#include "cgroup.c"    // Optional cgroup v2 confinement and accounting
+#include "shm.c"       // Shared memory publication for the shm sink
 #include "loadini.c"   // Handles loading/processing of INI cfg file
 
 static volatile int running;   // used to stop main loop 
 static volatile int handled;   // last signal that has been handled 
+static volatile int reporting; // used to request a usage report
 
 /*
  * Frees all members of the given thing that need freeing.
@@ -31,8 +36,38 @@ static void free_thing(thing_s *thing)
 		free(thing->output);
 	}
 
+	strbuf_free(&thing->segment);
+
+	strbuf_free(&thing->tmpl.head);
+	strbuf_free(&thing->tmpl.tail);
+
+	if (thing->cgroup)
+	{
+		free(thing->cgroup);
+	}
+
+	if (thing->errors)
+	{
+		free(thing->errors);
+	}
+
+	if (thing->subs)
+	{
+		free(thing->subs);
+	}
+
+	if (thing->input)
+	{
+		free(thing->input);
+	}
+
 	cfg_free(&thing->cfg);
 
+	if (thing->over.opts)
+	{
+		cfg_free(&thing->over);
+	}
+
 	if (thing->child)
 	{
 		char *arg = kita_child_get_arg(thing->child);
@@ -41,10 +76,10 @@ static void free_thing(thing_s *thing)
 }
 
 /*
- * Builds the command line options and arguments string for lemonbar.
- * Saves the string in buf and returns its length as reported by snprintf().
+ * Builds the command line options and arguments string for lemonbar and 
+ * appends it to the string buffer `sb`. Returns 0 on success, -1 on error.
  */
-int lemon_arg(thing_s *lemon, char *buf, size_t len)
+int lemon_arg(thing_s *lemon, strbuf_s *sb)
 {
 	cfg_s *lcfg = &lemon->cfg;
 
@@ -54,11 +89,6 @@ int lemon_arg(thing_s *lemon, char *buf, size_t len)
 	snprintf(w, BUFFER_NUMERIC, "%d", cfg_get_int(lcfg, LEMON_OPT_WIDTH));
 	snprintf(h, BUFFER_NUMERIC, "%d", cfg_get_int(lcfg, LEMON_OPT_HEIGHT));
 
-	char *block_font = optstr('f', cfg_get_str(lcfg, LEMON_OPT_BLOCK_FONT), 0);
-	char *label_font = optstr('f', cfg_get_str(lcfg, LEMON_OPT_LABEL_FONT), 0);
-	char *affix_font = optstr('f', cfg_get_str(lcfg, LEMON_OPT_AFFIX_FONT), 0);
-	char *name_str   = optstr('n', cfg_get_str(lcfg, LEMON_OPT_NAME), 0);
-
 	char *fg = cfg_get_str(lcfg, LEMON_OPT_FG);
 	char *bg = cfg_get_str(lcfg, LEMON_OPT_BG);
 	char *lc = cfg_get_str(lcfg, LEMON_OPT_LC);
@@ -70,8 +100,8 @@ int lemon_arg(thing_s *lemon, char *buf, size_t len)
 		snprintf(areas, 8, "-a%d", num_areas);
 	}
 
-	int res = snprintf(buf, len,
-		"-g %sx%s+%d+%d %s -F%s -B%s -U%s -u%d %s %s %s %s %s %s",
+	int res = strbuf_printf(sb,
+		"-g %sx%s+%d+%d %s -F%s -B%s -U%s -u%d %s %s",
 		cfg_has(lcfg, LEMON_OPT_WIDTH)  ? w : "",
 		cfg_has(lcfg, LEMON_OPT_HEIGHT) ? h : "",
 		cfg_get_int(lcfg, LEMON_OPT_X),
@@ -82,17 +112,24 @@ int lemon_arg(thing_s *lemon, char *buf, size_t len)
 		lc ? lc : "-",
 		cfg_get_int(lcfg, LEMON_OPT_LW),
 		cfg_get_int(lcfg, LEMON_OPT_BOTTOM) ? "-b" : "",
-		cfg_get_int(lcfg, LEMON_OPT_FORCE)  ? "-d" : "",
-		block_font,
-		label_font,
-		affix_font,
-		name_str
+		cfg_get_int(lcfg, LEMON_OPT_FORCE)  ? "-d" : ""
 	);
 
-	free(block_font);
-	free(label_font);
-	free(affix_font);
-	free(name_str);
+	// Fonts and name are quoted, as they might contain spaces
+	const char  flag[4] = { 'f', 'f', 'f', 'n' };
+	const char *vals[4] = {
+		cfg_get_str(lcfg, LEMON_OPT_BLOCK_FONT),
+		cfg_get_str(lcfg, LEMON_OPT_LABEL_FONT),
+		cfg_get_str(lcfg, LEMON_OPT_AFFIX_FONT),
+		cfg_get_str(lcfg, LEMON_OPT_NAME)
+	};
+	for (size_t i = 0; res == 0 && i < 4; ++i)
+	{
+		if (vals[i])
+		{
+			res = strbuf_printf(sb, " -%c\"%s\"", flag[i], vals[i]);
+		}
+	}
 
 	return res;
 }
@@ -105,28 +142,102 @@ static int open_lemon(thing_s *lemon)
 	// Make sure we free the previous argument string, if any
 	free(kita_child_get_arg(lemon->child));
 
-	// Need this on the heap, as kita_child_set_arg just saves a reference
-	char *arg = malloc(BUFFER_LEMON_ARG);
-	if (arg == NULL) return -1;
-
-	// Actually build the lemon's argument string
-	lemon_arg(lemon, arg, BUFFER_LEMON_ARG);
+	// Actually build the lemon's argument string; we hand the buffer's
+	// string over to kita_child_set_arg, which just saves a reference
+	strbuf_s arg = { 0 };
+	if (lemon_arg(lemon, &arg) == -1)
+	{
+		strbuf_free(&arg);
+		return -1;
+	}
 
-	// Set the argument string, open the process, set stdin to line buffered
-	kita_child_set_arg(lemon->child, arg);
+	// Set the argument string, open the process, make stdin non-blocking
+	kita_child_set_arg(lemon->child, arg.str);
 	if (kita_child_open(lemon->child) == 0)
 	{
-		return kita_child_set_buf_type(lemon->child, KITA_IOS_IN, KITA_BUF_LINE);
+		lemon->last_open = get_time();
+		lemon->alive = 1;
+		// We write to the bar with writev(), see write_frame()
+		return kita_child_set_blocking(lemon->child, KITA_IOS_IN, 0);
 	}
 
 	return -1;
 }
 
+/*
+ * Restarts the bar, if it has exited and its restart time has come, then 
+ * has it fed a fresh frame right away, so the bar shows the current state 
+ * without waiting for any blocks. If restarting fails, another attempt will 
+ * be scheduled. Returns 0 if the bar has been restarted, -1 if it was not 
+ * (yet) due or could not be restarted.
+ */
+static int restart_lemon(state_s *state, double now)
+{
+	thing_s *lemon = &state->lemon;
+
+	if (lemon->alive || now < state->restart)
+	{
+		return -1;
+	}
+
+	// The bar has closed its streams, but the process is still around
+	if (lemon->child->pid > 0)
+	{
+		kita_child_term(lemon->child);
+		state->restart = now + BLOCK_WAIT_TOLERANCE;
+		return -1;
+	}
+
+	if (open_lemon(lemon) == -1)
+	{
+		fprintf(stderr, "Failed to restart bar: %s\n", lemon->sid);
+		state->restart = now + state->backoff;
+		state->backoff = state->backoff * 2 > LEMON_BACKOFF_MAX ? 
+			LEMON_BACKOFF_MAX : state->backoff * 2;
+		return -1;
+	}
+
+	// Have the frame rebuilt from the blocks' segments and fed to the bar 
+	// right away, as part of the old one might have gone to the old bar
+	if (state->frame_len)
+	{
+		state->frame_len  = 0;
+		state->frame_sent = 0;
+		state->due = 1;
+	}
+	return 0;
+}
+
+/*
+ * Prepares the child process of the thing `ctx` right before its command is
+ * executed: moves it into the thing's cgroup, if any, so that everything the
+ * command does happens inside of it, and tells actions how many events they
+ * stand for. Runs in the child process, see kita_child_set_exec(). Returns 0.
+ */
+static int exec_thing(kita_child_s *child, void *ctx)
+{
+	thing_s *thing = ctx;
+	if (thing->cgroup)
+	{
+		cgroup_attach(thing->cgroup, getpid());
+	}
+	if (thing->t_type == THING_ACTION)
+	{
+		char repeat[BUFFER_NUMERIC * 2];
+		snprintf(repeat, sizeof(repeat), "%u", thing->repeat);
+		setenv(ACTION_REPEAT_ENV, repeat, 1);
+	}
+	return 0;
+}
+
 /*
  * Runs the thing's child process. Returns 0 on success, -1 on error.
  */
 static int open_thing(thing_s *thing)
 {
+	// Things might move in memory (see run_action()), so we hand the 
+	// child its thing anew every time
+	kita_child_set_exec(thing->child, exec_thing, thing);
 	if (kita_child_open(thing->child) == 0)
 	{
 		thing->last_open = get_time();
@@ -136,23 +247,335 @@ static int open_thing(thing_s *thing)
 	return -1;
 }
 
+/*
+ * Copies `len` bytes from `str` into the thing's output buffer, followed by 
+ * `mark`, if given, and a null terminator. The buffer is allocated on first 
+ * use and only ever grows, so that repeated updates don't need to allocate. 
+ * Returns 0 on success, -1 on error (in which case the old output is kept).
+ */
+static int set_output(thing_s *thing, const char *str, size_t len, const char *mark)
+{
+	size_t mark_len = mark ? strlen(mark) : 0;
+	if (len + mark_len + 1 > thing->output_size)
+	{
+		size_t size = thing->output_size ? thing->output_size : BUFFER_BLOCK_RESULT;
+		while (size < len + mark_len + 1)
+		{
+			size *= 2;
+		}
+
+		char *output = realloc(thing->output, size);
+		if (output == NULL)
+		{
+			return -1;
+		}
+		thing->output = output;
+		thing->output_size = size;
+	}
+
+	memcpy(thing->output, str, len);
+	memcpy(thing->output + len, mark, mark_len);
+	thing->output[len + mark_len] = '\0';
+	thing->output_len = len + mark_len;
+	thing->version += 1;
+	thing->dirty = 1;
+	return 0;
+}
+
+/*
+ * Sets the block's override for option `opt` to the first `len` bytes of 
+ * `val`, or removes it if `val` is NULL. The block is only marked for restyle
+ * if that changes the override's value.
+ */
+static void set_override(thing_s *block, block_opt_e opt, const char *val, size_t len)
+{
+	const char *old = cfg_get_str(&block->over, opt);
+	if (val && old && strlen(old) == len && strncmp(old, val, len) == 0)
+	{
+		return;
+	}
+	if (val == NULL && old == NULL)
+	{
+		return;
+	}
+
+	cfg_unset(&block->over, opt);
+	if (val)
+	{
+		cfg_set_str(&block->over, opt, strndup(val, len));
+	}
+	block->restyle = 1;
+}
+
+/*
+ * Parses the first `len` bytes of `line` as structured output: tab-separated 
+ * key=value fields, for example "text=12%<TAB>fg=#FF0000<TAB>urgent=true".
+ * The `text` field is what will be displayed, all other known fields override
+ * the block's option of the same name until the next update. Unknown fields
+ * and fields without '=' are ignored. Returns a pointer to the value of the 
+ * `text` field, which is not null-terminated, and writes its length to 
+ * `text_len`; if there is no `text` field, the text is empty.
+ */
+static const char *parse_fields(thing_s *block, const char *line, size_t len, size_t *text_len)
+{
+	static const struct { const char *key; block_opt_e opt; } keys[] = {
+		{ "fg",       BLOCK_OPT_FG       },
+		{ "bg",       BLOCK_OPT_BG       },
+		{ "lc",       BLOCK_OPT_LC       },
+		{ "label",    BLOCK_OPT_LABEL    },
+		{ "label-fg", BLOCK_OPT_LABEL_FG },
+		{ "label-bg", BLOCK_OPT_LABEL_BG },
+		{ "affix-fg", BLOCK_OPT_AFFIX_FG },
+		{ "affix-bg", BLOCK_OPT_AFFIX_BG },
+		{ "prefix",   BLOCK_OPT_PREFIX   },
+		{ "suffix",   BLOCK_OPT_SUFFIX   },
+		{ "unit",     BLOCK_OPT_UNIT     }
+	};
+
+	if (block->over.opts == NULL)
+	{
+		cfg_init(&block->over, block->sid, BLOCK_OPT_COUNT);
+	}
+	// Overrides that are missing from this line will be removed
+	unsigned char seen[BLOCK_OPT_COUNT] = { 0 };
+	int urgent = 0;
+
+	const char *text = line;
+	*text_len = 0;
+
+	const char *end = line + len;
+	const char *field = line;
+	while (field < end)
+	{
+		const char *tab = memchr(field, '\t', end - field);
+		const char *next = tab ? tab : end;
+		const char *eq = memchr(field, '=', next - field);
+
+		if (eq)
+		{
+			size_t key_len = eq - field;
+			const char *val = eq + 1;
+			size_t val_len = next - val;
+
+			if (key_len == 4 && strncmp(field, "text", 4) == 0)
+			{
+				text = val;
+				*text_len = val_len;
+			}
+			else if (key_len == 6 && strncmp(field, "urgent", 6) == 0)
+			{
+				urgent = (val_len == 4 && strncmp(val, "true", 4) == 0)
+					|| (val_len == 1 && val[0] == '1');
+			}
+			else
+			{
+				for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); ++i)
+				{
+					if (strlen(keys[i].key) == key_len && 
+							strncmp(field, keys[i].key, key_len) == 0)
+					{
+						set_override(block, keys[i].opt, val, val_len);
+						seen[keys[i].opt] = 1;
+						break;
+					}
+				}
+			}
+		}
+		field = next + 1;
+	}
+
+	for (size_t i = 0; i < BLOCK_OPT_COUNT; ++i)
+	{
+		if (!seen[i])
+		{
+			set_override(block, i, NULL, 0);
+		}
+	}
+
+	// Urgent blocks swap their colors, which is part of the template
+	if (urgent != block->urgent)
+	{
+		block->urgent = urgent;
+		block->restyle = 1;
+	}
+
+	return text;
+}
+
+/*
+ * Returns the value of the given string option of the block, taking into 
+ * account overrides from structured output, or NULL if the option isn't set.
+ */
+static const char *style_str(const thing_s *block, block_opt_e opt)
+{
+	if (block->over.opts && cfg_has(&block->over, opt))
+	{
+		return cfg_get_str(&block->over, opt);
+	}
+	return cfg_get_str(&block->cfg, opt);
+}
+
+/*
+ * Saves the first `len` bytes of `line` in the block's output field, cutting 
+ * them short according to the block's max-bytes and max-chars options. If 
+ * `trunc` is set, `line` has already been cut short (and has more bytes after
+ * `len`). Returns 1 if the new output is different from the previous output
+ * already present in the output field, 0 if it is the same or could not be 
+ * saved (in which case the previous output is kept).
+ */
+static int take_output(thing_s *block, const char *line, size_t len, int trunc)
+{
+	// Only take the line if its fingerprint differs from the last one
+	uint64_t h = hash(line, len, OUTPUT_HASH_SEED ^ trunc);
+	if (block->output && h == block->hash)
+	{
+		++block->suppressed;
+		return 0;
+	}
+
+	// Structured output: pick out the text and remember the overrides
+	if (cfg_get_int(&block->cfg, BLOCK_OPT_STRUCTURED))
+	{
+		const char *end = line + len;
+		line = parse_fields(block, line, len, &len);
+		trunc = trunc && line + len == end;
+	}
+
+	// Cut the line short if it exceeds max-bytes (if it was read by kita, 
+	// this has already been taken care of)
+	int max_bytes = cfg_get_int(&block->cfg, BLOCK_OPT_MAX_BYTES);
+	if (max_bytes > 0 && len > (size_t) max_bytes)
+	{
+		len = max_bytes;
+		trunc = 1;
+	}
+
+	// Cut the line short if it exceeds max-chars
+	int max_chars = cfg_get_int(&block->cfg, BLOCK_OPT_MAX_CHARS);
+	if (max_chars > 0)
+	{
+		size_t max_len = utf8_bytes(line, len, max_chars);
+		trunc = trunc || max_len < len;
+		len = max_len;
+	}
+
+	// Make room for the truncation mark within max-bytes, unless it doesn't
+	// fit at all, and within max-chars, where it counts as one character,
+	// then go back to the start of a partial UTF-8 sequence
+	const char *mark = trunc ? BLOCK_TRUNC_MARK : NULL;
+	size_t mark_len = mark ? strlen(mark) : 0;
+	if (mark && max_chars > 0)
+	{
+		len = utf8_bytes(line, len, max_chars - 1);
+	}
+	if (mark && max_bytes > 0 && len + mark_len > (size_t) max_bytes)
+	{
+		if ((size_t) max_bytes < mark_len)
+		{
+			mark = NULL;
+		}
+		else
+		{
+			len = max_bytes - mark_len;
+		}
+	}
+	while (trunc && len && (line[len] & 0xC0) == 0x80)
+	{
+		--len;
+	}
+
+	// Without the new output, there is nothing to show; as the fingerprint
+	// stays the same, the same line will be tried again next time
+	if (set_output(block, line, len, mark) == -1)
+	{
+		return 0;
+	}
+
+	if (trunc)
+	{
+		++block->truncated;
+	}
+
+	block->hash = h;
+	return 1;
+}
+
 /*
  * Read from the block's stdout and save the read data, if any, in the block's 
- * output field. Returns 0 if the read data was the same as the previous data
- * already present in the output field, 1 if the newly read data is different.
+ * output field. If no complete line could be read yet, the previous output is
+ * kept. Returns 0 if the read data was the same as the previous data already 
+ * present in the output field (or if there was none, or it couldn't be saved),
+ * 1 if it is different.
  */
 static int read_block(thing_s *block)
 {
-	char *old = block->output ? strdup(block->output) : NULL;
+	size_t len = 0;
+	const char *line = kita_child_peek(block->child, KITA_IOS_OUT, &len);
+	if (line == NULL)
+	{
+		return 0;
+	}
 
-	free(block->output); // just in case, free'ing NULL is fine
-	block->output = kita_child_read(block->child, KITA_IOS_OUT);
 	block->last_read = get_time();
-	
-	int same = (old && equals(old, block->output));
-	free(old);
 
-	return !same;
+	int trunc = kita_child_is_truncated(block->child, KITA_IOS_OUT);
+	int changed = take_output(block, line, len, trunc);
+
+	kita_child_consume(block->child, KITA_IOS_OUT);
+	return changed;
+}
+
+/*
+ * Replaces the overrides (from structured output) of block `dst` with those of
+ * block `src`, so that a block mirroring another one looks the same, except 
+ * for its own config options.
+ */
+static void copy_overrides(thing_s *dst, const thing_s *src)
+{
+	if (dst->urgent != src->urgent)
+	{
+		dst->urgent = src->urgent;
+		dst->restyle = 1;
+	}
+
+	if (src->over.opts == NULL)
+	{
+		return;
+	}
+	if (dst->over.opts == NULL)
+	{
+		cfg_init(&dst->over, dst->sid, BLOCK_OPT_COUNT);
+	}
+
+	for (size_t i = 0; i < BLOCK_OPT_COUNT; ++i)
+	{
+		const char *val = cfg_get_str(&src->over, i);
+		set_override(dst, i, val, val ? strlen(val) : 0);
+	}
+}
+
+/*
+ * Copies the block's output to all blocks that mirror it, if any.
+ */
+static void share_output(thing_s *block)
+{
+	if (block->output == NULL)
+	{
+		return;
+	}
+
+	thing_s *sub = NULL;
+	for (size_t i = 0; i < block->num_subs; ++i)
+	{
+		sub = block->subs[i];
+		if (set_output(sub, block->output, block->output_len, NULL) == -1)
+		{
+			continue;
+		}
+		copy_overrides(sub, block);
+		sub->hash = block->hash;
+		sub->last_read = block->last_read;
+	}
 }
 
 /*
@@ -161,13 +584,35 @@ static int read_block(thing_s *block)
  */
 static int read_spark(thing_s *spark)
 {
-	free(spark->output); // just in case, free'ing NULL is fine
-	spark->output = kita_child_read(spark->child, KITA_IOS_OUT);
+	size_t len = 0;
+	const char *line = kita_child_peek(spark->child, KITA_IOS_OUT, &len);
+	if (line == NULL)
+	{
+		return 0;
+	}
+
+	set_output(spark, line, len, NULL);
 	spark->last_read = get_time();
+	kita_child_consume(spark->child, KITA_IOS_OUT);
 
 	return !empty(spark->output);
 }
 
+/*
+ * Hands the spark's output to all blocks it triggers, so that every one of 
+ * them will be run (and possibly consume the output) on its own schedule.
+ */
+static void trigger_blocks(thing_s *spark)
+{
+	thing_s *block = NULL;
+	for (size_t i = 0; i < spark->num_subs; ++i)
+	{
+		block = spark->subs[i];
+		free(block->input); // free'ing NULL is fine
+		block->input = strdup(spark->output);
+	}
+}
+
 /*
  * Convenience function: simply opens all given triggers.
  * Returns the number of successfully opened triggers.
@@ -182,6 +627,20 @@ static size_t open_sparks(state_s *state)
 	return num_sparks_opened;
 }
 
+/*
+ * Convenience function: simply opens all (multiplexed) sources.
+ * Returns the number of successfully opened sources.
+ */ 
+static size_t open_sources(state_s *state)
+{
+	size_t num_sources_opened = 0;
+	for (size_t i = 0; i < state->num_sources; ++i)
+	{
+		num_sources_opened += (open_thing(&state->sources[i]) == 0);
+	}
+	return num_sources_opened;
+}
+
 /*
  * Convenience function: simply frees all given blocks.
  */
@@ -193,6 +652,17 @@ static void free_blocks(state_s *state)
 	}
 }
 
+/*
+ * Convenience function: simply frees all given sources.
+ */
+static void free_sources(state_s *state)
+{
+	for (size_t i = 0; i < state->num_sources; ++i)
+	{
+		free_thing(&state->sources[i]);
+	}
+}
+
 /*
  * Convenience function: simply frees all given sparks.
  */
@@ -208,14 +678,39 @@ static int block_can_consume(thing_s *block)
 {
 	return block->b_type == BLOCK_SPARKED
 		&& cfg_get_int(&block->cfg, BLOCK_OPT_CONSUME) 
-		&& !empty(block->other->output);
+		&& !empty(block->input);
+}
+
+/*
+ * Returns 1 if the block has actions waiting to be run, otherwise 0.
+ */
+static int actions_pending(const thing_s *block)
+{
+	for (int i = 0; i < ACTION_COUNT; ++i)
+	{
+		if (block->pending[i])
+		{
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Returns 1 if the block has as many actions running as its `action-limit`
+ * option allows, otherwise 0. A limit of 0 means there is no limit.
+ */
+static int actions_limited(const thing_s *block)
+{
+	int limit = cfg_get_int(&block->cfg, BLOCK_OPT_ACTION_LIMIT);
+	return limit > 0 && block->num_running >= (size_t) limit;
 }
 
 static double block_due_in(thing_s *block, double now)
 {
 	float reload = cfg_get_float(&block->cfg, BLOCK_OPT_RELOAD);
 
-	return block->b_type == BLOCK_TIMED ? 
+	return block->b_type == BLOCK_TIMED && block->source == NULL ? 
 		reload - (now - block->last_open) : 
 		DBL_MAX;
 }
@@ -228,6 +723,12 @@ static int block_is_due(thing_s *block, double now, double tolerance)
 		return 0;
 	}
 
+	// block mirrors another block's output, it never runs itself
+	if (block->source)
+	{
+		return 0;
+	}
+
 	// One-shot blocks are due if they have never been run before
 	if (block->b_type == BLOCK_ONCE)
 	{
@@ -257,7 +758,7 @@ static int block_is_due(thing_s *block, double now, double tolerance)
 		}
 
 		// spark has output waiting to be processed
-		if (block->other->output)
+		if (block->input)
 		{
 			return 1;
 		}
@@ -293,7 +794,7 @@ static size_t open_due_blocks(state_s *state, double now)
 		{
 			if (block_can_consume(block))
 			{
-				kita_child_set_arg(block->child, block->other->output);
+				kita_child_set_arg(block->child, block->input);
 				opened += (open_thing(block) == 0);
 				kita_child_set_arg(block->child, NULL);
 			}
@@ -303,8 +804,8 @@ static size_t open_due_blocks(state_s *state, double now)
 			}
 			if (block->b_type == BLOCK_SPARKED)
 			{
-				free(block->other->output);
-				block->other->output = NULL;
+				free(block->input);
+				block->input = NULL;
 			}
 		}
 	}
@@ -312,132 +813,310 @@ static size_t open_due_blocks(state_s *state, double now)
 }
 
 /*
- * Returns the time, in seconds, until the next block should be run.
- * If no blocks are scheduled for execution, -1 will be returned.
+ * Returns the number of seconds until the block's deferred update (see 
+ * update_block()) may be shown, which might be negative if it is overdue, or 
+ * DBL_MAX if the block doesn't have a deferred update.
  */
-static double time_to_wait(state_s *state, double now)
+static double update_due_in(const thing_s *block, double now)
 {
-	double lemon_due = DBL_MAX;
-	double thing_due = DBL_MAX;
-
-	for (size_t i = 0; i < state->num_blocks; ++i)
+	if (block->deferred == 0)
 	{
-		thing_due = block_due_in(&state->blocks[i], now);
-
-		if (thing_due < lemon_due)
-		{
-			lemon_due = thing_due;
-		}
+		return DBL_MAX;
 	}
-
-	return (lemon_due == DBL_MAX) ? -1 : lemon_due;
+	double rate = cfg_get_float(&block->cfg, BLOCK_OPT_MAX_RATE);
+	return (block->last_update + (1.0 / rate)) - now;
 }
 
 /*
- * Given a block, returns a malloc'd string that contains both the block's
- * output, as well as its unit string (if any). The length (excluding the 
- * null terminator) of the resulting string will be returned in `len` and 
- * the additional characters, that have been added due to escaping of the 
- * result and unit string, will be returned in `diff`, if given.
+ * Returns the number of seconds until the next frame may be rendered, given 
+ * the time of the last frame, `last`, according to the bar's max-fps, which 
+ * might be negative if it is overdue. Used for the bar and the sinks alike.
  */
-char* resultstr(const thing_s *block, int *len, size_t *diff)
+static double frame_due_in(const state_s *state, double last, double now)
 {
-	// The 'diff' will tell us how many extra characters the string gained
-	// because of escaping '%' signs; we need this amount for the min_width 
-	// value, because while those additional characters have to be taken 
-	// into account for snprintf(), they aren't part of the visible output
+	double fps = cfg_get_float(&state->lemon.cfg, LEMON_OPT_MAX_FPS);
+	if (fps <= 0.0)
+	{
+		return 0.0;
+	}
+	return (last + (1.0 / fps)) - now;
+}
 
-	const cfg_s *bcfg = &block->cfg;
-	
-	size_t rdiff = 0;
-	char *result = cfg_get_int(bcfg, BLOCK_OPT_RAW) ? 
-		strdup(block->output) : escape(block->output, '%', &rdiff);
+/*
+ * Schedules a bar update for the block's new output, unless the block has a 
+ * max-rate and its last update was too recent. In that case, the update is 
+ * deferred until the rate allows for it; if more output comes in until then,
+ * the newest output wins and the overwritten update is counted as dropped.
+ */
+static void update_block(state_s *state, thing_s *block, double now)
+{
+	double rate = cfg_get_float(&block->cfg, BLOCK_OPT_MAX_RATE);
+	if (rate > 0.0 && now - block->last_update < (1.0 / rate))
+	{
+		if (block->deferred)
+		{
+			++block->dropped;
+		}
+		block->deferred = 1;
+		return;
+	}
 
-	size_t udiff = 0;
-	char *unit = escape(strsel(cfg_get_str(bcfg, BLOCK_OPT_UNIT), "", ""), '%', &udiff);
+	block->last_update = now;
+	block->deferred = 0;
+	state->due = 1;
+	state->sinks_due = 1;
+}
 
-	if (diff)
+/*
+ * Schedules a bar update for all blocks with a deferred update that is due.
+ * This makes sure that the last output of a rate-limited block gets shown, 
+ * even if the block doesn't produce any more output. Returns the number of 
+ * updates scheduled.
+ */
+static size_t flush_updates(state_s *state, double now)
+{
+	size_t num_flushed = 0;
+	thing_s *block = NULL;
+	for (size_t i = 0; i < state->num_blocks; ++i)
 	{
-		*diff = rdiff + udiff;
+		block = &state->blocks[i];
+		if (update_due_in(block, now) <= 0.0)
+		{
+			block->last_update = now;
+			block->deferred = 0;
+			state->due = 1;
+			state->sinks_due = 1;
+			++num_flushed;
+		}
+	}
+	return num_flushed;
+}
+
+/*
+ * Returns the time, in seconds, until the next block should be run.
+ * If no blocks are scheduled for execution, -1 will be returned.
+ */
+static double time_to_wait(state_s *state, double now)
+{
+	double lemon_due = DBL_MAX;
+	double thing_due = DBL_MAX;
+	thing_s *block = NULL;
+
+	// The bar itself might be waiting to be restarted
+	if (state->lemon.alive == 0 && cfg_get_int(&state->lemon.cfg, LEMON_OPT_RESTART))
+	{
+		lemon_due = state->restart - now < 0.0 ? 0.0 : state->restart - now;
+	}
+
+	// An update might be waiting for the next frame (see max-fps), unless
+	// we're waiting for the bar to take the rest of the last frame
+	if (state->due && state->lemon.alive && 
+			(state->frame_sent == 0 || state->frame_sent == state->frame_len))
+	{
+		thing_due = frame_due_in(state, state->last_frame, now);
+		lemon_due = thing_due < 0.0 ? 0.0 : thing_due;
+	}
+
+	// Log lines might be waiting for stderr or the log file to take them
+	if (state->log_len)
+	{
+		lemon_due = lemon_due > WRITE_RETRY ? WRITE_RETRY : lemon_due;
+	}
+
+	// Sinks might be due a frame, or have output they didn't take yet
+	for (size_t i = 0; i < state->num_sinks; ++i)
+	{
+		if (state->sinks[i].out.len)
+		{
+			lemon_due = lemon_due > WRITE_RETRY ? WRITE_RETRY : lemon_due;
+		}
+	}
+	if (state->sinks_due && state->num_sinks)
+	{
+		thing_due = frame_due_in(state, state->last_sinks, now);
+		thing_due = thing_due < 0.0 ? 0.0 : thing_due;
+		lemon_due = thing_due < lemon_due ? thing_due : lemon_due;
 	}
 
-	size_t output_len = strlen(result) + strlen(unit) + 1;
-	char *output = malloc(sizeof(char) * output_len);
+	for (size_t i = 0; i < state->num_blocks; ++i)
+	{
+		block = &state->blocks[i];
+		thing_due = block_due_in(block, now);
+
+		if (thing_due < lemon_due)
+		{
+			lemon_due = thing_due;
+		}
+
+		// Rate-limited blocks might have an update waiting to be shown
+		thing_due = update_due_in(block, now);
+
+		if (thing_due < lemon_due)
+		{
+			lemon_due = thing_due < 0.0 ? 0.0 : thing_due;
+		}
 
-	*len = snprintf(output, output_len, "%s%s", result, unit);
+		// Pending actions are due once their debounce window has passed; 
+		// if the block's action limit has been reached, they have to wait 
+		// for one of its actions to end, which wakes us up anyway (see
+		// kita_wake_on_exit())
+		if (actions_pending(block) && !actions_limited(block))
+		{
+			thing_due = cfg_get_float(&block->cfg, BLOCK_OPT_DEBOUNCE) - (now - block->last_action);
 
-	free(result);
-	free(unit);
+			if (thing_due < lemon_due)
+			{
+				lemon_due = thing_due < 0.0 ? 0.0 : thing_due;
+			}
+		}
+	}
 
-	return output;
+	return (lemon_due == DBL_MAX) ? -1 : lemon_due;
 }
 
 /*
- * Given a block, writes a string to the given buf that is the formatted result 
- * of this block's script output, ready to be fed to Lemonbar, including prefix,
- * label and suffix. Returns the number of characters written to buf.
+ * Given a block, appends the block's output, as well as its unit string (if 
+ * any), to the string buffer `sb`. Returns the number of appended characters
+ * or -1 on error. The additional characters, that have been added due to 
+ * escaping of the result and unit string, will be returned in `diff`, if given.
  */
-int blockstr(const thing_s *lemon, const thing_s *block, char *buf, size_t len)
+int resultstr(const thing_s *block, strbuf_s *sb, size_t *diff)
 {
-	// for convenience
+	// The 'diff' will tell us how many extra characters the string gained
+	// because of escaping '%' signs; we need this amount for the min_width 
+	// value, because while those additional characters have to be taken 
+	// into account for the width, they aren't part of the visible output
+
 	const cfg_s *bcfg = &block->cfg;
-	const cfg_s *lcfg = &lemon->cfg;
+	size_t start = sb->len;
+	
+	int rdiff = 0;
+	if (cfg_get_int(bcfg, BLOCK_OPT_RAW))
+	{
+		rdiff = strbuf_append(sb, block->output, block->output_len);
+	}
+	else
+	{
+		rdiff = strbuf_escape(sb, block->output, block->output_len, '%');
+	}
+
+	const char *unit = strsel(style_str(block, BLOCK_OPT_UNIT), "", "");
+	int udiff = strbuf_escape(sb, unit, strlen(unit), '%');
+
+	if (rdiff < 0 || udiff < 0)
+	{
+		return -1;
+	}
+
+	if (diff)
+	{
+		*diff = rdiff + udiff;
+	}
+
+	return sb->len - start;
+}
+
+/*
+ * Appends a lemonbar format tag to the string buffer `sb` that changes the
+ * attributes (font, colors, over- and underline) from those in `cur` to those
+ * in `next`, mentioning only the attributes that actually differ; if none 
+ * differ, nothing is appended. The line color is left alone while no line is
+ * drawn, unless it is being reset to the default. Afterwards, `cur` will be 
+ * set to the attributes now in effect.
+ */
+static void attrstr(strbuf_s *sb, attr_s *cur, const attr_s *next)
+{
+	// The first attribute opens the tag, all others are separated by a space
+	const char *open = "%{";
+	const char *sep  = open;
 
-	char action_start[(5 * strlen(block->sid)) + 64];
-	char action_end[24];  
-	action_start[0] = 0;
-	action_end[0]   = 0;
+	int lines = next->ol || next->ul;
+	int set_lc = strcmp(next->lc, cur->lc) && (lines || strcmp(next->lc, "-") == 0);
 
-	if (cfg_has(bcfg, BLOCK_OPT_CMD_LMB))
+	if (next->font != cur->font)
+	{
+		strbuf_printf(sb, "%sT%c", sep, next->font);
+		sep = " ";
+	}
+	if (strcmp(next->fg, cur->fg))
 	{
-		strcat(action_start, "%{A1:");
-		strcat(action_start, block->sid);
-		strcat(action_start, "_lmb:}");
-		strcat(action_end, "%{A}");
+		strbuf_printf(sb, "%sF%s", sep, next->fg);
+		sep = " ";
 	}
-	if (cfg_has(bcfg, BLOCK_OPT_CMD_MMB))
+	if (strcmp(next->bg, cur->bg))
 	{
-		strcat(action_start, "%{A2:");
-		strcat(action_start, block->sid);
-		strcat(action_start, "_mmb:}");
-		strcat(action_end, "%{A}");
+		strbuf_printf(sb, "%sB%s", sep, next->bg);
+		sep = " ";
 	}
-	if (cfg_has(bcfg, BLOCK_OPT_CMD_RMB))
+	if (set_lc)
 	{
-		strcat(action_start, "%{A3:");
-		strcat(action_start, block->sid);
-		strcat(action_start, "_rmb:}");
-		strcat(action_end, "%{A}");
+		strbuf_printf(sb, "%sU%s", sep, next->lc);
+		sep = " ";
 	}
-	if (cfg_has(bcfg, BLOCK_OPT_CMD_SUP))
+	if (next->ol != cur->ol)
 	{
-		strcat(action_start, "%{A4:");
-		strcat(action_start, block->sid);
-		strcat(action_start, "_sup:}");
-		strcat(action_end, "%{A}");
+		strbuf_printf(sb, "%s%co", sep, next->ol ? '+' : '-');
+		sep = " ";
 	}
-	if (cfg_has(bcfg, BLOCK_OPT_CMD_SDN))
+	if (next->ul != cur->ul)
 	{
-		strcat(action_start, "%{A5:");
-		strcat(action_start, block->sid);
-		strcat(action_start, "_sdn:}");
-		strcat(action_end, "%{A}");
+		strbuf_printf(sb, "%s%cu", sep, next->ul ? '+' : '-');
+		sep = " ";
 	}
 
-	// TODO we're missing the UNIT option, add that! let's have the
-	//      unit have the same foreground and background color as 
-	//      the actual block result string, that should be okay.
-	//      but, be careful! the length of the unit string, plus the 
-	//      separating space, need to be taken into account when 
-	//      calculating the padding (fixed width) of the block, no?
+	if (sep != open)
+	{
+		strbuf_puts(sb, "}");
+	}
+
+	// If the line color wasn't emitted, lemonbar still has the old one
+	const char *lc = set_lc ? next->lc : cur->lc;
+	*cur = *next;
+	cur->lc = lc;
+}
+
+/*
+ * Compiles the block's template: everything that makes up the block string 
+ * except for the block's output (and unit) - that is margins, action tags, 
+ * colors, fonts, prefix, label and suffix - does not change between renders,
+ * so we format it once, into a head (everything in front of the output) and 
+ * a tail (everything after it). This needs to happen again whenever the 
+ * block's overrides (see parse_fields()) change. Returns 0 on success, -1 on
+ * error, in which case the block is left without a template and will be 
+ * compiled again on next render.
+ */
+static int compile_block(const thing_s *lemon, thing_s *block)
+{
+	// for convenience
+	const cfg_s *bcfg = &block->cfg;
+	const cfg_s *lcfg = &lemon->cfg;
+
+	// Clickable areas, one for every mouse button that has a command
+	static const struct { block_opt_e opt; char btn; const char *name; } acts[] = {
+		{ BLOCK_OPT_CMD_LMB, '1', "lmb" },
+		{ BLOCK_OPT_CMD_MMB, '2', "mmb" },
+		{ BLOCK_OPT_CMD_RMB, '3', "rmb" },
+		{ BLOCK_OPT_CMD_SUP, '4', "sup" },
+		{ BLOCK_OPT_CMD_SDN, '5', "sdn" }
+	};
 
-	const char *block_fg = strsel(cfg_get_str(bcfg, BLOCK_OPT_FG),       "-", "");
-	const char *block_bg = strsel(cfg_get_str(bcfg, BLOCK_OPT_BG),       "-", "");
-	const char *label_fg = strsel(cfg_get_str(bcfg, BLOCK_OPT_LABEL_FG), "-", "");
-	const char *label_bg = strsel(cfg_get_str(bcfg, BLOCK_OPT_LABEL_BG), "-", "");
-	const char *affix_fg = strsel(cfg_get_str(bcfg, BLOCK_OPT_AFFIX_FG), "-", "");
-	const char *affix_bg = strsel(cfg_get_str(bcfg, BLOCK_OPT_AFFIX_BG), "-", "");
-	const char *lc       = strsel(cfg_get_str(bcfg, BLOCK_OPT_LC),       "-", "");
+	size_t num_acts = sizeof(acts) / sizeof(acts[0]);
+
+	const char *block_fg = strsel(style_str(block, BLOCK_OPT_FG),       "-", "");
+	const char *block_bg = strsel(style_str(block, BLOCK_OPT_BG),       "-", "");
+	const char *label_fg = strsel(style_str(block, BLOCK_OPT_LABEL_FG), "-", "");
+	const char *label_bg = strsel(style_str(block, BLOCK_OPT_LABEL_BG), "-", "");
+	const char *affix_fg = strsel(style_str(block, BLOCK_OPT_AFFIX_FG), "-", "");
+	const char *affix_bg = strsel(style_str(block, BLOCK_OPT_AFFIX_BG), "-", "");
+	const char *lc       = strsel(style_str(block, BLOCK_OPT_LC),       "-", "");
+
+	// Urgent blocks stand out by swapping their colors
+	if (block->urgent)
+	{
+		const char *fg = block_fg;
+		block_fg = block_bg;
+		block_bg = fg;
+	}
 
 	int font_count = 0;
 
@@ -445,87 +1124,227 @@ int blockstr(const thing_s *lemon, const thing_s *block, char *buf, size_t len)
 	char label_font_idx = cfg_get_str(lcfg, LEMON_OPT_LABEL_FONT) ? (++font_count) + '0' : '-'; // 2nd slot
 	char affix_font_idx = cfg_get_str(lcfg, LEMON_OPT_AFFIX_FONT) ? (++font_count) + '0' : '-'; // 3rd slot
 
-	const char *prefix   = strsel(cfg_get_str(bcfg, BLOCK_OPT_PREFIX), "", "");
-	const char *suffix   = strsel(cfg_get_str(bcfg, BLOCK_OPT_SUFFIX), "", "");
-	const char *label    = strsel(cfg_get_str(bcfg, BLOCK_OPT_LABEL),  "", "");
+	const char *prefix   = strsel(style_str(block, BLOCK_OPT_PREFIX), "", "");
+	const char *suffix   = strsel(style_str(block, BLOCK_OPT_SUFFIX), "", "");
+	const char *label    = strsel(style_str(block, BLOCK_OPT_LABEL),  "", "");
 
-	int padding_l = cfg_get_int(bcfg, BLOCK_OPT_PADDING_LEFT);
-	int padding_r = cfg_get_int(bcfg, BLOCK_OPT_PADDING_RIGHT);
 	int margin_l  = cfg_get_int(bcfg, BLOCK_OPT_MARGIN_LEFT);
 	int margin_r  = cfg_get_int(bcfg, BLOCK_OPT_MARGIN_RIGHT);
 	int ol        = cfg_get_int(bcfg, BLOCK_OPT_OL);
 	int ul        = cfg_get_int(bcfg, BLOCK_OPT_UL);
 
-	int     rlen      = 0;
-	size_t  rdiff     = 0;
-	char   *result    = resultstr(block, &rlen, &rdiff);
-	int     min_width = cfg_get_int(bcfg, BLOCK_OPT_MIN_WIDTH) + rdiff;
-
-	// TODO currently we are adding the format thingies for label, 
-	//      prefix and suffix, even if those are empty anyway, which
-	//      makes the string much longer than it needs to be, hence 
-	//      also increasing the parsing workload for lemonbar.
-	//      but of course, replacing a couple bytes with lots of malloc
-	//      would not be great either, so... not sure about it yet.
-
 	// TODO bug! bug! bug! we just used font slots 1 to 3 here, but maybe
 	//      we're only loading one or two (or zero) fonts! NO BUENO!
 
-	int res = snprintf(buf, len,
-		"%%{O%d}"                                      // margin left
-		"%s"                                           // action start
-		"%%{F%s B%s U%s %co %cu}"                      // format start
-		"%%{T%c F%s B%s}%s"                            // prefix
-		"%%{T%c F%s B%s}%s"                            // label
-		"%%{T%c F%s B%s}%*s%*s%*s"                     // block
-		"%%{T%c F%s B%s}%s"                            // suffix
-		"%%{T- F- B- U- -o -u}"                        // format end
-		"%s"                                           // action end
-		"%%{O%d}",                                     // margin right
-		// margin left
-		margin_l,
-		// action start
-		action_start,
-		// format start       
-		block_fg, block_bg, lc, (ol ? '+' : '-'), (ul ? '+' : '-'),
-		// prefix
-		affix_font_idx, affix_fg, affix_bg, prefix,
-		// label
-		label_font_idx, label_fg, label_bg, label,
-		// block
-		block_font_idx, block_fg, block_bg, padding_l, "", min_width, result, padding_r, "",
-		// suffix
-		affix_font_idx, affix_fg, affix_bg, suffix,
-		// action end
-		action_end,
-		// margin right
-		margin_r
-	);
+	// Every block starts and ends with lemonbar's defaults in effect, so
+	// a cached block string can go anywhere in the bar; in between, we 
+	// only emit the attributes that change from one part to the next
+	const attr_s none  = { '-', "-", "-", "-", 0, 0 };
+	const attr_s affix = { affix_font_idx, affix_fg, affix_bg, lc, ol, ul };
+	const attr_s lbl   = { label_font_idx, label_fg, label_bg, lc, ol, ul };
+	const attr_s body  = { block_font_idx, block_fg, block_bg, lc, ol, ul };
+	attr_s cur = none;
 
-	free(result);
-	return res;
+	tmpl_s *tmpl = &block->tmpl;
+	strbuf_s *head = &tmpl->head;
+	strbuf_s *tail = &tmpl->tail;
+	strbuf_reset(head);
+	strbuf_reset(tail);
+
+	// Either part may well end up empty, but it has to exist, see blockstr()
+	strbuf_append(head, "", 0);
+	strbuf_append(tail, "", 0);
+
+	if (margin_l)
+	{
+		strbuf_printf(head, "%%{O%d}", margin_l);
+	}
+	for (size_t i = 0; i < num_acts; ++i)
+	{
+		if (cfg_has(bcfg, acts[i].opt))
+		{
+			strbuf_printf(head, "%%{A%c:%s_%s:}", acts[i].btn, block->sid, acts[i].name);
+		}
+	}
+	if (prefix[0])
+	{
+		attrstr(head, &cur, &affix);
+		strbuf_puts(head, prefix);
+	}
+	if (label[0])
+	{
+		attrstr(head, &cur, &lbl);
+		strbuf_puts(head, label);
+	}
+	attrstr(head, &cur, &body);
+
+	if (suffix[0])
+	{
+		attrstr(tail, &cur, &affix);
+		strbuf_puts(tail, suffix);
+	}
+	attrstr(tail, &cur, &none);
+	for (size_t i = 0; i < num_acts; ++i)
+	{
+		if (cfg_has(bcfg, acts[i].opt))
+		{
+			strbuf_puts(tail, "%{A}");
+		}
+	}
+	if (margin_r)
+	{
+		strbuf_printf(tail, "%%{O%d}", margin_r);
+	}
+
+	if (head->str == NULL || tail->str == NULL)
+	{
+		strbuf_free(head);
+		strbuf_free(tail);
+		return -1;
+	}
+
+	tmpl->padding_l = cfg_get_int(bcfg, BLOCK_OPT_PADDING_LEFT);
+	tmpl->padding_r = cfg_get_int(bcfg, BLOCK_OPT_PADDING_RIGHT);
+	tmpl->min_width = cfg_get_int(bcfg, BLOCK_OPT_MIN_WIDTH);
+
+	block->restyle = 0;
+	return 0;
+}
+
+/*
+ * Convenience function: compiles the templates of all blocks.
+ * Returns the number of successfully compiled templates.
+ */
+static size_t compile_blocks(state_s *state)
+{
+	size_t num_compiled = 0;
+	for (size_t i = 0; i < state->num_blocks; ++i)
+	{
+		num_compiled += (compile_block(&state->lemon, &state->blocks[i]) == 0);
+	}
+	return num_compiled;
+}
+
+/*
+ * Given a block, appends a string to the string buffer `sb` that is the 
+ * formatted result of this block's script output, ready to be fed to Lemonbar,
+ * including prefix, label and suffix, by filling the output and padding into
+ * the block's compiled template (see compile_block()). Returns the number of 
+ * appended characters or -1 on error (or if the block has no template).
+ */
+int blockstr(const thing_s *block, strbuf_s *sb)
+{
+	const tmpl_s *tmpl = &block->tmpl;
+	if (tmpl->head.str == NULL)
+	{
+		return -1;
+	}
+
+	size_t start = sb->len;
+	size_t pad_l = tmpl->padding_l > 0 ? tmpl->padding_l : 0;
+	size_t pad_r = tmpl->padding_r > 0 ? tmpl->padding_r : 0;
+
+	strbuf_append(sb, tmpl->head.str, tmpl->head.len);
+	strbuf_fill(sb, ' ', pad_l);
+
+	size_t rdiff = 0;
+	size_t rpos  = sb->len;
+	int    rlen  = resultstr(block, sb, &rdiff);
+	if (rlen < 0)
+	{
+		return -1;
+	}
+
+	// The result is right-aligned within min_width; as we only know its 
+	// length now, we shift it to the right to make room for the spaces.
+	// The escaped '%' signs aren't visible, so they don't count for width
+	size_t width = tmpl->min_width + rdiff;
+	size_t fill  = (size_t) rlen < width ? width - rlen : 0;
+	if (fill && strbuf_fill(sb, ' ', fill) == 0)
+	{
+		memmove(sb->str + rpos + fill, sb->str + rpos, rlen);
+		memset(sb->str + rpos, ' ', fill);
+	}
+
+	strbuf_fill(sb, ' ', pad_r);
+	if (strbuf_append(sb, tmpl->tail.str, tmpl->tail.len) == -1)
+	{
+		return -1;
+	}
+
+	return sb->len - start;
+}
+
+/*
+ * Renders the block string (see blockstr()) into the block's segment buffer,
+ * unless the block's output hasn't changed since it was last rendered, in 
+ * which case the cached segment is used as-is. Returns the length of the 
+ * segment or -1 on error.
+ */
+static int render_block(state_s *state, thing_s *block)
+{
+	if (block->segment.str && !block->dirty)
+	{
+		return block->segment.len;
+	}
+
+	// Overrides changed, the template needs to be compiled again
+	if (block->restyle || block->tmpl.head.str == NULL)
+	{
+		compile_block(&state->lemon, block);
+	}
+
+	strbuf_reset(&block->segment);
+	if (blockstr(block, &block->segment) < 0)
+	{
+		return -1;
+	}
+
+	block->dirty = 0;
+	return block->segment.len;
 }
 
 /*
- * Returns 'l', 'c' or 'r' for input values -1, 0 and 1 respectively.
- * For other input values, the behavior is undefined.
+ * Adds a span of `len` bytes, starting at `base`, to the state's frame.
+ * Returns 0 on success, -1 on error.
  */
-static char get_align(const int align)
+static int add_span(state_s *state, const char *base, size_t len)
 {
-	char a[] = {'l', 'c', 'r'};
-	return a[align+1]; 
+	if (state->frame_spans == state->frame_size)
+	{
+		size_t size = state->frame_size ? state->frame_size * 2 : 8;
+		struct iovec *frame = realloc(state->frame, size * sizeof(struct iovec));
+		if (frame == NULL)
+		{
+			return -1;
+		}
+		state->frame = frame;
+		state->frame_size = size;
+	}
+
+	state->frame[state->frame_spans++] = (struct iovec) {
+		.iov_base = (void *) base, .iov_len = len 
+	};
+	return 0;
 }
 
 /*
- * Combines the results of all given blocks into a single string that can be fed
- * to Lemonbar. Returns a pointer to the string, allocated with malloc().
+ * Combines the results of all given blocks into a frame that can be fed to 
+ * Lemonbar, re-rendering only blocks whose output has changed (see 
+ * render_block()). Instead of copying everything into one string, the frame 
+ * is made up of spans that point to the blocks' segments, the separator and
+ * so on, which can be written all at once with writev(); hence, none of them 
+ * may change until the frame has been written. Returns the length of the 
+ * frame, in bytes, or -1 on error.
  */
-static char *barstr(const state_s *state)
+static ssize_t build_frame(state_s *state)
 {
+	static const char *aligns[] = { "%{l}", "%{c}", "%{r}" };
+
 	// This should never happen, but just in case (also makes compiler happy)
 	if (state->num_blocks == 0)
 	{
-		return NULL;
+		return -1;
 	}
 	
 	// For convenience
@@ -535,17 +1354,13 @@ static char *barstr(const state_s *state)
 	char *sep = cfg_get_str(&state->lemon.cfg, LEMON_OPT_SEPARATOR);
 	size_t sep_len = sep ? strlen(sep) : 0;
 
-	// Short blocks like temperature, volume or battery, will usually use 
-	// something in the range of 130 to 200 byte. So let's go with 256 byte.
-	size_t bar_str_len = BUFFER_BLOCK_RESULT * num_blocks;
-	char *bar_str = malloc(bar_str_len);
-	bar_str[0] = '\0';
+	state->frame_spans = 0;
+	size_t len = 0;
+	int res = 0;
 
-	char align[5];
 	int last_align = -1;
 
-	char block_str[BUFFER_BLOCK_STR];
-	const thing_s *block = NULL;
+	thing_s *block = NULL;
 	for (size_t i = 0; i < num_blocks; ++i)
 	{
 		block = &state->blocks[i];
@@ -560,39 +1375,36 @@ static char *barstr(const state_s *state)
 		int block_align = cfg_get_int(&block->cfg, BLOCK_OPT_ALIGN);
 		int same_align = block_align == last_align;
 
-		// Build the block string
-		int block_str_len = blockstr(&state->lemon, block, block_str, BUFFER_BLOCK_STR);
+		// Get the block string, only re-rendering it if it changed
+		if (render_block(state, block) < 0)
+		{
+			continue;
+		}
 
 		// Potentially change the alignment
 		if (!same_align)
 		{
 			last_align = block_align;
-			snprintf(align, 5, "%%{%c}", get_align(last_align));
-			strcat(bar_str, align);
+			res |= add_span(state, aligns[last_align + 1], 4);
+			len += 4;
 		}
 		
-		// Let's check if this block string can fit in our buffer
-		size_t free_len = bar_str_len - (strlen(bar_str) + sep_len + 1);
-		if (block_str_len > free_len)
-		{
-			// Let's make space for approx. two more blocks
-			bar_str_len += BUFFER_BLOCK_RESULT * 2; 
-			bar_str = realloc(bar_str, bar_str_len);
-		}
-
 		// Possibly add the block separator in front of the block
 		if (sep && same_align && i)
 		{
-			strcat(bar_str, sep);
+			res |= add_span(state, sep, sep_len);
+			len += sep_len;
 		}
 
 		// Add this block's result to the bar string
-		strcat(bar_str, block_str);
+		res |= add_span(state, block->segment.str, block->segment.len);
+		len += block->segment.len;
 	}
 
-	strcat(bar_str, "\n");
-	bar_str = realloc(bar_str, strlen(bar_str) + 1);
-	return bar_str;
+	res |= add_span(state, "\n", 1);
+	len += 1;
+
+	return res ? -1 : (ssize_t) len;
 }
 
 /*
@@ -683,56 +1495,368 @@ static thing_s *get_block(const state_s *state, const char *sid)
 }
 
 /*
- * Add the block with the given SID to the collection of blocks, unless there 
- * is already a block with that SID present. 
- * Returns a pointer to the added (or existing) block or NULL in case of error.
+ * Returns the command that should be run for the given block.
  */
-static thing_s *add_block(state_s *state, const char *sid)
+static const char *block_cmd(const thing_s *block)
 {
-	// See if there is an existing block by this name (and return, if so)
-	thing_s *eb = get_block(state, sid);
-	if (eb)
-	{
-		return eb;
-	}
-
-	// Resize the block container to be able to hold one more block
-	size_t current  =   state->num_blocks;
-	size_t new_size = ++state->num_blocks * sizeof(thing_s);
-	thing_s *blocks = realloc(state->blocks, new_size);
-	if (blocks == NULL)
-	{
-		fprintf(stderr, "add_block(): realloc() failed!\n");
-		--state->num_blocks;
-		return NULL;
-	}
-	state->blocks = blocks;
-
-	// Create the block, setting its name and default values
-	state->blocks[current] = (thing_s) { 0 };
-	state->blocks[current].sid    = strdup(sid);
-	state->blocks[current].t_type = THING_BLOCK;
-	state->blocks[current].b_type = BLOCK_ONCE;
-	cfg_init(&state->blocks[current].cfg, "default", BLOCK_OPT_COUNT);
-
-	// Return a pointer to the new block
-	return &state->blocks[current];
+	const char *bin = cfg_get_str(&block->cfg, BLOCK_OPT_BIN);
+	return bin ? bin : block->sid;
 }
 
 /*
- * inih doc: "Handler should return nonzero on success, zero on error."
+ * Returns 1 if both blocks would run the same command at the same time and 
+ * treat its output the same way, which means they can share one process, 
+ * otherwise 0.
  */
-int lemon_cfg_handler(void *data, const char *section, const char *name, const char *value)
+static int blocks_identical(const thing_s *b1, const thing_s *b2)
 {
-	state_s *state = (state_s*) data;
+	if (b1->b_type != b2->b_type)
+	{
+		return 0;
+	}
 
-	// Only process if section is empty or specificially for bar
-	if (empty(section) || equals(section, state->lemon.sid))
+	// Sparked blocks depend on their trigger, so we leave them alone
+	if (b1->b_type != BLOCK_ONCE && b1->b_type != BLOCK_TIMED && b1->b_type != BLOCK_LIVE)
 	{
-		return lemon_ini_handler(&state->lemon, section, name, value);
+		return 0;
 	}
 
-	return 1;
+	if (cfg_get_float(&b1->cfg, BLOCK_OPT_RELOAD) != cfg_get_float(&b2->cfg, BLOCK_OPT_RELOAD))
+	{
+		return 0;
+	}
+
+	// A mirror gets the output as it was taken, see share_output()
+	static const block_opt_e outs[] = {
+		BLOCK_OPT_STRUCTURED, BLOCK_OPT_RAW, BLOCK_OPT_MAX_BYTES, BLOCK_OPT_MAX_CHARS
+	};
+	for (size_t i = 0; i < sizeof(outs) / sizeof(outs[0]); ++i)
+	{
+		if (cfg_get_int(&b1->cfg, outs[i]) != cfg_get_int(&b2->cfg, outs[i]))
+		{
+			return 0;
+		}
+	}
+	if (cfg_get_float(&b1->cfg, BLOCK_OPT_MAX_RATE) != cfg_get_float(&b2->cfg, BLOCK_OPT_MAX_RATE))
+	{
+		return 0;
+	}
+
+	return equals(block_cmd(b1), block_cmd(b2));
+}
+
+/*
+ * Adds `sub` to the list of blocks that mirror the output of `block`.
+ * Returns 0 on success, -1 on error.
+ */
+static int add_sub(thing_s *block, thing_s *sub)
+{
+	size_t new_size = (block->num_subs + 1) * sizeof(thing_s*);
+	thing_s **subs = realloc(block->subs, new_size);
+	if (subs == NULL)
+	{
+		fprintf(stderr, "add_sub(): realloc() failed!\n");
+		return -1;
+	}
+	block->subs = subs;
+	block->subs[block->num_subs++] = sub;
+	return 0;
+}
+
+/*
+ * Finds and returns the (multiplexed) source with the given name -- or NULL.
+ */
+static thing_s *get_mux(const state_s *state, const char *sid)
+{
+	if (sid == NULL)
+	{
+		return NULL;
+	}
+	for (size_t i = 0; i < state->num_sources; ++i)
+	{
+		if (equals(state->sources[i].sid, sid))
+		{
+			return &state->sources[i];
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Add a (multiplexed) source with the given name, unless there already is one.
+ * Returns a pointer to the added (or existing) source or NULL on error.
+ */
+static thing_s *add_mux(state_s *state, const char *sid)
+{
+	thing_s *es = get_mux(state, sid);
+	if (es)
+	{
+		return es;
+	}
+
+	// Resize the source array to be able to hold one more source
+	size_t current  =   state->num_sources;
+	size_t new_size = ++state->num_sources * sizeof(thing_s);
+	thing_s *sources = realloc(state->sources, new_size);
+	if (sources == NULL)
+	{
+		fprintf(stderr, "add_mux(): realloc() failed!\n");
+		--state->num_sources;
+		return NULL;
+	}
+	state->sources = sources;
+
+	state->sources[current] = (thing_s) { 0 };
+	state->sources[current].sid    = strdup(sid);
+	state->sources[current].t_type = THING_SOURCE;
+	cfg_init(&state->sources[current].cfg, sid, BLOCK_OPT_COUNT);
+
+	return &state->sources[current];
+}
+
+/*
+ * Creates a (multiplexed) source for every section that is named as a source 
+ * by a block, but isn't a block itself. Their config sections still need to 
+ * be loaded, see load_source_cfg(). Returns the number of sources.
+ */
+static size_t create_muxes(state_s *state)
+{
+	for (size_t i = 0; i < state->num_blocks; ++i)
+	{
+		const char *sid = cfg_get_str(&state->blocks[i].cfg, BLOCK_OPT_SOURCE);
+		if (sid && !equals(sid, ALBEDO_SID) && get_block(state, sid) == NULL)
+		{
+			add_mux(state, sid);
+		}
+	}
+	return state->num_sources;
+}
+
+/*
+ * Returns the max length of lines read from the (multiplexed) source `mux`: 
+ * the longest block name, the tab and the largest max-bytes of its blocks.
+ * Returns 0 if one of them has no max-bytes, so that only the read buffer's 
+ * size applies. Either way, the rest of an overlong line is dropped, instead
+ * of being taken for a line of its own (and routed to the wrong block).
+ */
+static size_t source_max_line(const thing_s *mux)
+{
+	size_t max_sid   = 0;
+	size_t max_bytes = 0;
+	for (size_t i = 0; i < mux->num_subs; ++i)
+	{
+		int sub_bytes = cfg_get_int(&mux->subs[i]->cfg, BLOCK_OPT_MAX_BYTES);
+		if (sub_bytes <= 0)
+		{
+			return 0;
+		}
+		size_t sid_len = strlen(mux->subs[i]->sid);
+		max_sid   = sid_len > max_sid ? sid_len : max_sid;
+		max_bytes = (size_t) sub_bytes > max_bytes ? (size_t) sub_bytes : max_bytes;
+	}
+	return max_sid + 1 + max_bytes;
+}
+
+/*
+ * Reads all lines from the (multiplexed) source's stdout, each of which should
+ * have the format <blockname><TAB><output>, and hands the output to the named
+ * block, if it gets its output from this source. Lines for unknown blocks and 
+ * lines without a tab are ignored. Sets the state's `due` flag via 
+ * update_block() for every block whose output changed. Returns the number of
+ * lines routed to a block.
+ */
+static size_t route_output(state_s *state, thing_s *mux)
+{
+	double now = get_time();
+	size_t num_routed = 0;
+	size_t len = 0;
+	const char *line = NULL;
+	while ((line = kita_child_peek(mux->child, KITA_IOS_OUT, &len)))
+	{
+		const char *tab = memchr(line, '\t', len);
+		size_t sid_len  = tab ? (size_t) (tab - line) : 0;
+
+		thing_s *block = NULL;
+		for (size_t i = 0; tab && i < mux->num_subs; ++i)
+		{
+			if (strncmp(mux->subs[i]->sid, line, sid_len) == 0 
+					&& mux->subs[i]->sid[sid_len] == '\0')
+			{
+				block = mux->subs[i];
+				break;
+			}
+		}
+
+		if (block)
+		{
+			block->last_read = now;
+			int trunc = kita_child_is_truncated(mux->child, KITA_IOS_OUT);
+			if (take_output(block, tab + 1, len - sid_len - 1, trunc))
+			{
+				share_output(block);
+				update_block(state, block, now);
+			}
+			++num_routed;
+		}
+
+		kita_child_consume(mux->child, KITA_IOS_OUT);
+	}
+	mux->last_read = now;
+	return num_routed;
+}
+
+/*
+ * Follows the chain of `source` options, starting at the given block, and 
+ * returns the block at the end of it, which is the one that actually runs
+ * (or gets its output from a multiplexed source). Returns NULL if the block 
+ * has no source block, the source could not be found or the chain of sources
+ * turns out to be circular.
+ */
+static thing_s *get_source(const state_s *state, thing_s *block)
+{
+	thing_s *source = block;
+	thing_s *next = NULL;
+
+	// A chain can't be longer than the number of blocks, unless circular
+	for (size_t i = 0; i <= state->num_blocks; ++i)
+	{
+		const char *sid = cfg_get_str(&source->cfg, BLOCK_OPT_SOURCE);
+		next = source->source ? source->source : (sid ? get_block(state, sid) : NULL);
+
+		if (next == NULL || next->t_type == THING_SOURCE)
+		{
+			return source == block ? NULL : source;
+		}
+		source = next;
+	}
+	return NULL;
+}
+
+/*
+ * Finds blocks that would run the same command with the same interval as a 
+ * previous block, as well as blocks that explicitly name another block as 
+ * their source, and makes them mirror the output of that block instead of 
+ * running a process of their own. Returns the number of mirroring blocks.
+ */
+static size_t share_blocks(state_s *state)
+{
+	size_t num_shared = 0;
+	thing_s *block = NULL;
+	thing_s *other = NULL;
+
+	// Blocks that run the exact same command as a previous block
+	for (size_t i = 0; i < state->num_blocks; ++i)
+	{
+		block = &state->blocks[i];
+		if (cfg_has(&block->cfg, BLOCK_OPT_SOURCE))
+		{
+			continue;
+		}
+
+		for (size_t j = 0; j < i; ++j)
+		{
+			other = &state->blocks[j];
+			if (other->source || cfg_has(&other->cfg, BLOCK_OPT_SOURCE))
+			{
+				continue;
+			}
+			if (blocks_identical(block, other) && add_sub(other, block) == 0)
+			{
+				block->source = other;
+				++num_shared;
+				break;
+			}
+		}
+	}
+
+	// Blocks that get their output from a multiplexed source
+	for (size_t i = 0; i < state->num_blocks; ++i)
+	{
+		block = &state->blocks[i];
+		other = get_mux(state, cfg_get_str(&block->cfg, BLOCK_OPT_SOURCE));
+		if (other && add_sub(other, block) == 0)
+		{
+			block->source = other;
+			++num_shared;
+		}
+	}
+
+	// Blocks that name their source (block) explicitly
+	for (size_t i = 0; i < state->num_blocks; ++i)
+	{
+		block = &state->blocks[i];
+		if (!cfg_has(&block->cfg, BLOCK_OPT_SOURCE) || block->source)
+		{
+			continue;
+		}
+
+		other = get_source(state, block);
+		if (other == NULL || other == block)
+		{
+			fprintf(stderr, "share_blocks(): invalid source for block '%s'\n", block->sid);
+			continue;
+		}
+		if (add_sub(other, block) == 0)
+		{
+			block->source = other;
+			++num_shared;
+		}
+	}
+
+	return num_shared;
+}
+
+/*
+ * Add the block with the given SID to the collection of blocks, unless there 
+ * is already a block with that SID present. 
+ * Returns a pointer to the added (or existing) block or NULL in case of error.
+ */
+static thing_s *add_block(state_s *state, const char *sid)
+{
+	// See if there is an existing block by this name (and return, if so)
+	thing_s *eb = get_block(state, sid);
+	if (eb)
+	{
+		return eb;
+	}
+
+	// Resize the block container to be able to hold one more block
+	size_t current  =   state->num_blocks;
+	size_t new_size = ++state->num_blocks * sizeof(thing_s);
+	thing_s *blocks = realloc(state->blocks, new_size);
+	if (blocks == NULL)
+	{
+		fprintf(stderr, "add_block(): realloc() failed!\n");
+		--state->num_blocks;
+		return NULL;
+	}
+	state->blocks = blocks;
+
+	// Create the block, setting its name and default values
+	state->blocks[current] = (thing_s) { 0 };
+	state->blocks[current].sid    = strdup(sid);
+	state->blocks[current].t_type = THING_BLOCK;
+	state->blocks[current].b_type = BLOCK_ONCE;
+	cfg_init(&state->blocks[current].cfg, "default", BLOCK_OPT_COUNT);
+
+	// Return a pointer to the new block
+	return &state->blocks[current];
+}
+
+/*
+ * inih doc: "Handler should return nonzero on success, zero on error."
+ */
+int lemon_cfg_handler(void *data, const char *section, const char *name, const char *value)
+{
+	state_s *state = (state_s*) data;
+
+	// Only process if section is empty or specificially for bar
+	if (empty(section) || equals(section, state->lemon.sid))
+	{
+		return lemon_ini_handler(&state->lemon, section, name, value);
+	}
+
+	return 1;
 }
 
 /*
@@ -793,183 +1917,1359 @@ static int load_block_cfg(state_s *state)
 		return -3;
 	}
 
-	return ini_parse(state->prefs.config, block_cfg_handler, state);
-}
+	return ini_parse(state->prefs.config, block_cfg_handler, state);
+}
+
+/*
+ * inih doc: "Handler should return nonzero on success, zero on error."
+ */
+int source_cfg_handler(void *data, const char *section, const char *name, const char *value)
+{
+	state_s *state = (state_s*) data;
+
+	// Find the source whose name fits the section name, ignore others
+	thing_s *mux = empty(section) ? NULL : get_mux(state, section);
+	if (mux == NULL)
+	{
+		return 1;
+	}
+
+	// Sources are configured just like blocks (not all options apply)
+	return block_ini_handler(mux, section, name, value);
+}
+
+/*
+ * Parse the config once more, this time processing the sections of sources.
+ * Returns 0 on success, -1 on file open error, -2 on memory allocation error, 
+ * -3 if no config file path was given in the preferences, or the line number 
+ * of the first encountered parse error.
+ */
+static int load_source_cfg(state_s *state)
+{
+	// Abort if config file path empty or NULL
+	if (empty(state->prefs.config))
+	{
+		return -3;
+	}
+
+	return ini_parse(state->prefs.config, source_cfg_handler, state);
+}
+
+/*
+ * Finds and returns the spark that runs the given command -- or NULL.
+ */
+static thing_s *get_spark(state_s *state, const char *cmd)
+{
+	for (size_t i = 0; i < state->num_sparks; ++i)
+	{
+		if (equals(state->sparks[i].child->cmd, cmd))
+		{
+			return &state->sparks[i];
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Add a spark for the given trigger command, unless there already is a spark 
+ * for that command; all blocks using the same trigger will share one spark.
+ * Returns a pointer to the added (or existing) spark or NULL in case of error.
+ */
+static thing_s *add_spark(state_s *state, const char *cmd)
+{
+	// See if there is an existing spark that runs the given command
+	thing_s *es = get_spark(state, cmd);
+	if (es)
+	{
+		return es;
+	}
+
+	// Create the child process first, as we identify sparks by it
+	kita_child_s *child = make_child(state, cmd, 0, 1, 0);
+	if (child == NULL)
+	{
+		fprintf(stderr, "add_spark(): make_child() failed!\n");
+		return NULL;
+	}
+
+	// Resize the spark array to be able to hold one more spark
+	size_t current  =   state->num_sparks;
+	size_t new_size = ++state->num_sparks * sizeof(thing_s);
+	thing_s *sparks = realloc(state->sparks, new_size);
+	if (sparks == NULL)
+	{
+		fprintf(stderr, "add_spark(): realloc() failed!\n");
+		--state->num_sparks;
+		kita_child_free(&child);
+		return NULL;
+	}
+	state->sparks = sparks; 
+	 
+	state->sparks[current] = (thing_s) { 0 };
+	state->sparks[current].t_type = THING_SPARK;
+	state->sparks[current].child  = child;
+
+	// Return a pointer to the new spark
+	return &state->sparks[current];
+}
+
+/*
+ * Creates one spark per distinct trigger command, then subscribes every 
+ * sparked block to the spark that runs its trigger. This is done in two 
+ * steps, as adding sparks moves the spark array around in memory.
+ * Returns the number of sparks created.
+ */
+static size_t create_sparks(state_s *state)
+{
+	thing_s *block = NULL;
+	for (size_t i = 0; i < state->num_blocks; ++i)
+	{
+		block = &state->blocks[i];
+
+		if (block->b_type != BLOCK_SPARKED)
+		{
+			continue;
+		}
+
+		char *trigger = cfg_get_str(&block->cfg, BLOCK_OPT_TRIGGER);
+		if (empty(trigger))
+		{
+			fprintf(stderr, "create_sparks(): missing trigger for sparked block '%s'\n", block->sid);
+			continue;
+		}
+
+		add_spark(state, trigger);
+	}
+
+	for (size_t i = 0; i < state->num_blocks; ++i)
+	{
+		block = &state->blocks[i];
+
+		if (block->b_type != BLOCK_SPARKED)
+		{
+			continue;
+		}
+
+		char *trigger = cfg_get_str(&block->cfg, BLOCK_OPT_TRIGGER);
+		thing_s *spark = empty(trigger) ? NULL : get_spark(state, trigger);
+		if (spark && add_sub(spark, block) == 0)
+		{
+			block->other = spark;
+		}
+	}
+
+	return state->num_sparks;
+}
+
+/*
+ * Creates a cgroup leaf for every block below the cgroup directory given in the 
+ * bar's config, applying the block's CPU and memory limits, if any. Blocks that 
+ * name the same leaf via their `cgroup` option will share it. Sparks are put 
+ * into the leaf of the first block they trigger, sources into the leaf of the
+ * first block they feed. Returns the number of leaves.
+ */
+static size_t create_cgroups(state_s *state)
+{
+	char *root = cfg_get_str(&state->lemon.cfg, LEMON_OPT_CGROUP);
+	if (empty(root))
+	{
+		return 0;
+	}
+
+	size_t num_leaves = 0;
+	thing_s *block = NULL;
+	for (size_t i = 0; i < state->num_blocks; ++i)
+	{
+		block = &state->blocks[i];
+		const char *name = strsel(cfg_get_str(&block->cfg, BLOCK_OPT_CGROUP), block->sid, "");
+
+		block->cgroup = cgroup_leaf(root, name);
+		if (block->cgroup == NULL)
+		{
+			fprintf(stderr, "create_cgroups(): failed to create cgroup '%s' for block '%s'\n", name, block->sid);
+			continue;
+		}
+
+		char *cpu_max = cfg_get_str(&block->cfg, BLOCK_OPT_CPU_MAX);
+		if (cpu_max && cgroup_write(block->cgroup, "cpu.max", cpu_max) == -1)
+		{
+			fprintf(stderr, "create_cgroups(): failed to set cpu.max for block '%s'\n", block->sid);
+		}
+
+		char *memory_max = cfg_get_str(&block->cfg, BLOCK_OPT_MEMORY_MAX);
+		if (memory_max && cgroup_write(block->cgroup, "memory.max", memory_max) == -1)
+		{
+			fprintf(stderr, "create_cgroups(): failed to set memory.max for block '%s'\n", block->sid);
+		}
+
+		++num_leaves;
+	}
+
+	for (size_t i = 0; i < state->num_sparks; ++i)
+	{
+		thing_s *spark = &state->sparks[i];
+		if (spark->num_subs && spark->subs[0]->cgroup)
+		{
+			spark->cgroup = strdup(spark->subs[0]->cgroup);
+		}
+	}
+
+	for (size_t i = 0; i < state->num_sources; ++i)
+	{
+		thing_s *mux = &state->sources[i];
+		if (mux->num_subs && mux->subs[0]->cgroup)
+		{
+			mux->cgroup = strdup(mux->subs[0]->cgroup);
+		}
+	}
+
+	return num_leaves;
+}
+
+/*
+ * Removes the cgroup leaves of all blocks, see create_cgroups(), killing 
+ * whatever processes are still running in them. Leaves shared by several 
+ * blocks are removed with the first one. Returns the number of leaves that
+ * could not be removed.
+ */
+static size_t remove_cgroups(state_s *state)
+{
+	size_t failed = 0;
+	thing_s *block = NULL;
+	for (size_t i = 0; i < state->num_blocks; ++i)
+	{
+		block = &state->blocks[i];
+		if (block->cgroup && cgroup_remove(block->cgroup) == -1)
+		{
+			fprintf(stderr, "remove_cgroups(): failed to remove cgroup '%s'\n", block->cgroup);
+			++failed;
+		}
+	}
+	return failed;
+}
+
+/*
+ * Appends the given line, prefixed with the section name `sid`, to the log 
+ * buffer, which will be written out by flush_log(). If the buffer is full, 
+ * the line is dropped instead, so that a flood of output can't make us wait.
+ * Returns 0 on success, -1 if the line was dropped.
+ */
+static int log_line(state_s *state, const char *sid, const char *line, size_t len)
+{
+	if (state->log == NULL && (state->log = malloc(BUFFER_LOG)) == NULL)
+	{
+		return -1;
+	}
+
+	size_t sid_len = strlen(sid);
+	if (state->log_len + sid_len + len + 3 > BUFFER_LOG)
+	{
+		++state->log_dropped;
+		return -1;
+	}
+
+	char *end = state->log + state->log_len;
+	memcpy(end, sid, sid_len);
+	memcpy(end + sid_len, ": ", 2);
+	memcpy(end + sid_len + 2, line, len);
+	end[sid_len + 2 + len] = '\n';
+
+	state->log_len += sid_len + len + 3;
+	return 0;
+}
+
+/*
+ * Writes as much of the log buffer to the log file as it will take without 
+ * blocking, keeping the rest for the next call. On errors other than EAGAIN, 
+ * the buffered lines are discarded. Returns the number of bytes written.
+ */
+static size_t flush_log(state_s *state)
+{
+	if (state->log_len == 0)
+	{
+		return 0;
+	}
+
+	ssize_t n = write(state->log_fd, state->log, state->log_len);
+	if (n == -1)
+	{
+		if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+		{
+			state->log_len = 0;
+		}
+		return 0;
+	}
+
+	memmove(state->log, state->log + n, state->log_len - n);
+	state->log_len -= n;
+	return n;
+}
+
+/*
+ * Returns the `n`-th most recent line the thing printed to stderr (with 0 
+ * being the most recent one) or NULL if there is no such line, either 
+ * because the thing didn't print that many or because n >= BLOCK_ERR_LINES.
+ */
+static const char *get_error(const thing_s *thing, size_t n)
+{
+	if (thing->errors == NULL || n >= thing->num_errors || n >= BLOCK_ERR_LINES)
+	{
+		return NULL;
+	}
+	size_t idx = (thing->num_errors - 1 - n) % BLOCK_ERR_LINES;
+	return thing->errors + (idx * BUFFER_ERR_LINE);
+}
+
+/*
+ * Reads all complete lines from the thing's stderr, keeping the last 
+ * BLOCK_ERR_LINES of them around (see get_error()) and adding them to the 
+ * log, if the thing is the bar or a block with the 'log' option set. 
+ * Returns the number of lines read.
+ */
+static size_t read_errors(state_s *state, thing_s *thing)
+{
+	int log = thing->t_type == THING_LEMON || cfg_get_int(&thing->cfg, BLOCK_OPT_LOG);
+
+	if (thing->errors == NULL)
+	{
+		thing->errors = malloc(BLOCK_ERR_LINES * BUFFER_ERR_LINE);
+	}
+
+	size_t num_read = 0;
+	size_t len = 0;
+	const char *line = NULL;
+	while ((line = kita_child_peek(thing->child, KITA_IOS_ERR, &len)))
+	{
+		if (thing->errors)
+		{
+			char *slot = thing->errors + 
+				((thing->num_errors % BLOCK_ERR_LINES) * BUFFER_ERR_LINE);
+			size_t slot_len = len < BUFFER_ERR_LINE ? len : BUFFER_ERR_LINE - 1;
+			memcpy(slot, line, slot_len);
+			slot[slot_len] = '\0';
+		}
+		if (log)
+		{
+			log_line(state, thing->sid, line, len);
+		}
+
+		kita_child_consume(thing->child, KITA_IOS_ERR);
+		++thing->num_errors;
+		++num_read;
+	}
+	return num_read;
+}
+
+/*
+ * Prints a usage report, one line per block, to the given stream, each 
+ * followed by the last lines the block has printed to stderr, if any.
+ */
+static void report(const state_s *state, FILE *where)
+{
+	const thing_s *block = NULL;
+	for (size_t i = 0; i < state->num_blocks; ++i)
+	{
+		block = &state->blocks[i];
+		fprintf(where, "%s: suppressed=%zu truncated=%zu dropped=%zu", 
+				block->sid, block->suppressed, block->truncated, block->dropped);
+
+		if (block->cgroup)
+		{
+			fprintf(where, " cpu_usec=%lld user_usec=%lld system_usec=%lld memory=%lld",
+				cgroup_read(block->cgroup, "cpu.stat", "usage_usec"),
+				cgroup_read(block->cgroup, "cpu.stat", "user_usec"),
+				cgroup_read(block->cgroup, "cpu.stat", "system_usec"),
+				cgroup_read(block->cgroup, "memory.current", NULL));
+		}
+
+		fprintf(where, "\n");
+
+		// Last lines from stderr, oldest first
+		const char *error = NULL;
+		for (size_t n = BLOCK_ERR_LINES; n-- > 0;)
+		{
+			if ((error = get_error(block, n)))
+			{
+				fprintf(where, "%s! %s\n", block->sid, error);
+			}
+		}
+	}
+
+	if (state->log_dropped)
+	{
+		fprintf(where, "log: dropped=%zu\n", state->log_dropped);
+	}
+
+	fprintf(where, "frames: fed=%zu suppressed=%zu replaced=%zu last=%zu avg=%zu\n", 
+		state->num_frames, state->frames_suppressed, state->frames_replaced, state->frame_len, state->num_frames ? state->frame_bytes / state->num_frames : 0);
+	for (size_t i = 0; i < state->num_sinks; ++i)
+	{
+		fprintf(where, "sink %s: frames=%zu dropped=%zu%s\n", state->sinks[i].path,
+			state->sinks[i].frames, state->sinks[i].dropped,
+			state->sinks[i].fd == -1 ? " (closed)" : "");
+	}
+}
+
+/*
+ * Returns the action type for the given action name (for example, "lmb" for
+ * a left click) or -1 if the name is not a known action type.
+ */
+static int action_type(const char *name)
+{
+	const char *names[ACTION_COUNT] = { "lmb", "mmb", "rmb", "sup", "sdn" };
+	for (int i = 0; i < ACTION_COUNT; ++i)
+	{
+		if (equals(name, names[i]))
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+/*
+ * Runs the block's command for the given action type in a 'fire and forget' 
+ * manner, with the number of action events that have been coalesced into 
+ * this one run in the environment variable SUCCADE_REPEAT. The process is 
+ * kept track of as an action, so we know how many actions a block has got 
+ * running. Does not invoke a shell, hence no shell built-in functionality 
+ * can be used in the command. Returns 0 on success, -1 on error.
+ */
+static int run_action(state_s *state, thing_s *block, action_type_e type, unsigned count)
+{
+	char *cmd = cfg_get_str(&block->cfg, BLOCK_OPT_CMD_LMB + type);
+	if (empty(cmd))
+	{
+		return -1;
+	}
+
+	kita_child_s *child = make_child(state, cmd, 0, 0, 0);
+	if (child == NULL)
+	{
+		return -1;
+	}
+
+	// Resize the action array to be able to hold one more action
+	size_t current  =   state->num_actions;
+	size_t new_size = ++state->num_actions * sizeof(thing_s);
+	thing_s *actions = realloc(state->actions, new_size);
+	if (actions == NULL)
+	{
+		fprintf(stderr, "run_action(): realloc() failed!\n");
+		--state->num_actions;
+		kita_child_free(&child);
+		return -1;
+	}
+	state->actions = actions;
+
+	thing_s *action = &state->actions[current];
+	*action = (thing_s) { 0 };
+	action->t_type = THING_ACTION;
+	action->child  = child;
+	action->other  = block;
+	action->cgroup = block->cgroup ? strdup(block->cgroup) : NULL;
+	action->repeat = count;
+
+	// Failed opens get pruned later on, see prune_actions()
+	if (open_thing(action) == -1)
+	{
+		return -1;
+	}
+	++block->num_running;
+	return 0;
+}
+
+/*
+ * Runs all of the block's pending actions for as long as the block's action 
+ * limit allows. If the block has a debounce window, each action is only run 
+ * once, regardless of how many events have been coalesced into it; if not, 
+ * it is run once for every event. Returns the number of actions run.
+ */
+static size_t run_actions(state_s *state, thing_s *block)
+{
+	int coalesce = cfg_get_float(&block->cfg, BLOCK_OPT_DEBOUNCE) > 0.0;
+	size_t run = 0;
+	for (int i = 0; i < ACTION_COUNT; ++i)
+	{
+		while (block->pending[i])
+		{
+			if (actions_limited(block))
+			{
+				return run;
+			}
+			unsigned count = coalesce ? block->pending[i] : 1;
+			run += (run_action(state, block, i, count) == 0);
+			block->pending[i] -= count;
+		}
+	}
+	return run;
+}
+
+/*
+ * Runs the pending actions of all blocks whose debounce window has passed, 
+ * that is, blocks that have not received another action event for at least 
+ * `debounce` seconds. Returns the number of actions run.
+ */
+static size_t run_due_actions(state_s *state, double now)
+{
+	size_t run = 0;
+	thing_s *block = NULL;
+	for (size_t i = 0; i < state->num_blocks; ++i)
+	{
+		block = &state->blocks[i];
+		if (!actions_pending(block))
+		{
+			continue;
+		}
+		double debounce = cfg_get_float(&block->cfg, BLOCK_OPT_DEBOUNCE);
+		if (now - block->last_action >= debounce)
+		{
+			run += run_actions(state, block);
+		}
+	}
+	return run;
+}
+
+/*
+ * Removes all actions whose process has ended (and been reaped) or could not 
+ * be run in the first place. Returns the number of actions removed.
+ */
+static size_t prune_actions(state_s *state)
+{
+	size_t pruned = 0;
+	size_t i = 0;
+	thing_s *action = NULL;
+	while (i < state->num_actions)
+	{
+		action = &state->actions[i];
+		if (action->alive || action->child->pid > 0)
+		{
+			++i;
+			continue;
+		}
+
+		kita_child_free(&action->child);
+		action->child = NULL;
+		free_thing(action);
+
+		// Move the last action into the free spot
+		state->actions[i] = state->actions[--state->num_actions];
+		++pruned;
+	}
+	return pruned;
+}
+
+/*
+ * Takes a string of length `len` (which doesn't need to be null-terminated) 
+ * that might represent an action that was registered with one of the blocks 
+ * and tries to find the associated block. If found, the action will be 
+ * queued: if the block has a debounce window, consecutive events of the same 
+ * action (think a fast scroll) are coalesced into one run of the command, 
+ * which happens once the window has passed (see run_due_actions()), with 
+ * `now` being the time of the event. Returns 0 on success, -1 if the string 
+ * was not a recognized action command or the block that the action belongs 
+ * to could not be found.
+ */
+static int process_action(state_s *state, const char *action, size_t len, double now)
+{
+	// A valid action command should have the format <blockname>_<cmd-type>
+	// For example, for a block named `datetime` that was clicked with the 
+	// left mouse button, `action` should be "datetime_lmb"
+
+	if (len < 5) 
+	{
+		return -1;	// Can not be an action command, too short
+	}
+	
+	// Extract the type suffix, including the underscore
+	char type[5]; 
+	snprintf(type, 5, "%.4s", action + len - 4);
+
+	// Extract everything _before_ the suffix (this is the block name)
+	char block[len-3];
+	snprintf(block, len - 3, "%.*s", (int) len - 4, action); 
+
+	// Find the source block of the action
+	thing_s *source = get_block(state, block);
+	if (source == NULL)
+	{
+		return -1;
+	}
+
+	// Figure out the action type (skipping the underscore)
+	int t = type[0] == '_' ? action_type(type + 1) : -1;
+	if (t == -1 || !cfg_has(&source->cfg, BLOCK_OPT_CMD_LMB + t))
+	{
+		// Invalid action type (how in the world did that happen?)
+		return -1;
+	}
+
+	// A different action than before ends the previous burst of actions
+	if (source->pending[t] == 0)
+	{
+		run_actions(state, source);
+	}
+
+	++source->pending[t];
+	source->last_action = now;
+	return 0;
+}
+
+/*
+ * Reads all action commands that the bar has printed since the last call and 
+ * processes them in order, see process_action(). Actions of blocks without a 
+ * debounce window are run once the entire batch has been processed, one run 
+ * for every event, as far as the blocks' action limits allow.
+ * Returns the number of lines read.
+ */
+static size_t process_actions(state_s *state)
+{
+	double now = get_time();
+	size_t num_lines = 0;
+	size_t len = 0;
+	const char *line = NULL;
+	while ((line = kita_child_peek(state->lemon.child, KITA_IOS_OUT, &len)))
+	{
+		process_action(state, line, len, now);
+		kita_child_consume(state->lemon.child, KITA_IOS_OUT);
+		++num_lines;
+	}
+
+	if (num_lines)
+	{
+		run_due_actions(state, now);
+	}
+	return num_lines;
+}
+
+/*
+ * Writes as much of the state's frame to the bar as it will take without 
+ * blocking. Whatever it doesn't take will be written once it signals that it
+ * is ready for more (see on_child_feedok()). Returns the number of bytes of 
+ * the frame that are still waiting to be written, or -1 on error.
+ */
+static ssize_t write_frame(state_s *state)
+{
+	while (state->frame_sent < state->frame_len)
+	{
+		size_t cnt = state->frame_spans - state->frame_pos;
+		ssize_t num = kita_child_feedv(state->lemon.child, 
+				state->frame + state->frame_pos, cnt > LEMON_FEED_SPANS ? LEMON_FEED_SPANS : cnt);
+
+		// The bar is gone; we'll start over with a fresh frame once it's back
+		if (num == -1)
+		{
+			state->frame_sent = state->frame_len;
+			return -1;
+		}
+
+		// The pipe is full, we'll wait for the bar to catch up
+		if (num == 0)
+		{
+			break;
+		}
+
+		// Skip the spans that have been written, trim the one that 
+		// was written partially, if any, so we continue from there
+		state->frame_sent += num;
+		struct iovec *span = NULL;
+		while (num > 0)
+		{
+			span = &state->frame[state->frame_pos];
+			if ((size_t) num < span->iov_len)
+			{
+				span->iov_base = (char *) span->iov_base + num;
+				span->iov_len -= num;
+				break;
+			}
+			num -= span->iov_len;
+			state->frame_pos += 1;
+		}
+	}
+	return state->frame_len - state->frame_sent;
+}
+
+/*
+ * Feeds the bar a new frame, if an update is due and the bar's max-fps allows
+ * for it; otherwise, the update stays due and whatever changes come in until 
+ * the next frame is allowed will be shown together. A frame that is identical
+ * to the previous one (a block changing back and forth, for example) is not 
+ * fed to the bar at all. The same goes while the bar hasn't taken all of the 
+ * previous frame yet; once it has, it will be fed the newest state right away.
+ */
+static void feed_lemon(state_s *state, double now)
+{
+	if (state->due == 0)
+	{
+		return;
+	}
+
+	// The bar is being restarted, we'll feed it once it's back
+	if (state->lemon.alive == 0)
+	{
+		return;
+	}
+
+	// Too soon, we'll be back once the next frame is due; we can't wait 
+	// for less than a millisecond, so that is close enough
+	if (frame_due_in(state, state->last_frame, now) * MILLISEC_PER_SEC >= 1.0)
+	{
+		return;
+	}
+
+	// The bar is still busy with part of the last frame, which has to be 
+	// finished, lest the bar gets a garbled line; a frame that hasn't been
+	// started on at all, however, is out of date and will be replaced
+	if (state->frame_sent > 0 && state->frame_sent < state->frame_len)
+	{
+		return;
+	}
+	int replace = state->frame_sent < state->frame_len;
+
+	// If this fails, the spans of a frame that was waiting to be sent have 
+	// been overwritten already, so there is nothing left to send
+	ssize_t len = build_frame(state);
+	if (len < 0)
+	{
+		state->frame_len  = 0;
+		state->frame_sent = 0;
+		state->frame_pos  = 0;
+		return;
+	}
+
+	// Deferred updates are being taken care of with this frame
+	for (size_t i = 0; i < state->num_blocks; ++i)
+	{
+		state->blocks[i].deferred = 0;
+	}
+
+	state->due = 0;
+
+	uint64_t h = OUTPUT_HASH_SEED;
+	for (size_t i = 0; i < state->frame_spans; ++i)
+	{
+		h = hash(state->frame[i].iov_base, state->frame[i].iov_len, h);
+	}
+
+	// Same as what the bar shows (or is about to show) already
+	if (state->frame_len && h == state->frame_hash && (size_t) len == state->frame_len)
+	{
+		++state->frames_suppressed;
+		if (replace == 0)
+		{
+			return;
+		}
+	}
+	else if (replace)
+	{
+		++state->frames_replaced;
+	}
+
+	state->frame_len   = len;
+	state->frame_sent  = 0;
+	state->frame_pos   = 0;
+	state->frame_hash  = h;
+	state->last_frame  = now;
+	state->num_frames  += 1;
+	state->frame_bytes += len;
+
+	write_frame(state);
+}
+
+/*
+ * Appends the block's text, that is prefix, label, output, unit and suffix,
+ * to the string buffer `sb`, without any markup. If `tsv` is set, tabs and 
+ * newlines are replaced with spaces, so that the text makes for one field of
+ * a tab-separated line. Returns 0 on success, -1 on error.
+ */
+static int plain_block(const thing_s *block, strbuf_s *sb, int tsv)
+{
+	size_t start = sb->len;
+	int res = 0;
+
+	res |= strbuf_puts(sb, strsel(style_str(block, BLOCK_OPT_PREFIX), "", ""));
+	res |= strbuf_puts(sb, strsel(style_str(block, BLOCK_OPT_LABEL),  "", ""));
+	res |= strbuf_append(sb, block->output, block->output_len);
+	res |= strbuf_puts(sb, strsel(style_str(block, BLOCK_OPT_UNIT),   "", ""));
+	res |= strbuf_puts(sb, strsel(style_str(block, BLOCK_OPT_SUFFIX), "", ""));
+
+	if (tsv && res == 0)
+	{
+		for (char *c = sb->str + start; *c; ++c)
+		{
+			if (*c == '\t' || *c == '\n')
+			{
+				*c = ' ';
+			}
+		}
+	}
+	return res ? -1 : 0;
+}
+
+/*
+ * Appends the block as an i3bar JSON object to the string buffer `sb`, see
+ * https://i3wm.org/docs/i3bar-protocol.html. Returns 0 on success, -1 on error.
+ */
+static int i3bar_block(const thing_s *block, strbuf_s *sb)
+{
+	strbuf_s text = { 0 };
+	if (plain_block(block, &text, 0) == -1)
+	{
+		strbuf_free(&text);
+		return -1;
+	}
+
+	const char *fg = strsel(style_str(block, BLOCK_OPT_FG), "-", "-");
+	const char *bg = strsel(style_str(block, BLOCK_OPT_BG), "-", "-");
+
+	int res = 0;
+	res |= strbuf_puts(sb, "{\"name\":\"");
+	res |= strbuf_json(sb, block->sid, strlen(block->sid));
+	res |= strbuf_puts(sb, "\",\"full_text\":\"");
+	res |= strbuf_json(sb, text.str, text.len);
+	res |= strbuf_puts(sb, "\"");
+	if (!equals(fg, "-"))
+	{
+		res |= strbuf_puts(sb, ",\"color\":\"");
+		res |= strbuf_json(sb, fg, strlen(fg));
+		res |= strbuf_puts(sb, "\"");
+	}
+	if (!equals(bg, "-"))
+	{
+		res |= strbuf_puts(sb, ",\"background\":\"");
+		res |= strbuf_json(sb, bg, strlen(bg));
+		res |= strbuf_puts(sb, "\"");
+	}
+	if (block->urgent)
+	{
+		res |= strbuf_puts(sb, ",\"urgent\":true");
+	}
+	res |= strbuf_puts(sb, "}");
+
+	strbuf_free(&text);
+	return res ? -1 : 0;
+}
+
+/*
+ * Renders the block into the given sink's segment for it, unless the block's
+ * output hasn't changed since, in which case the segment is used as-is. Each 
+ * sink keeps its own segments, so none of them depends on when the others, 
+ * or the bar, last rendered the block. Returns 0 on success, -1 on error.
+ */
+static int render_sink_block(state_s *state, sink_s *sink, size_t idx)
+{
+	thing_s  *block   = &state->blocks[idx];
+	strbuf_s *segment = &sink->segments[idx];
+
+	if (segment->str && sink->versions[idx] == block->version)
+	{
+		return 0;
+	}
+
+	strbuf_reset(segment);
+	int res = 0;
+	switch (sink->type)
+	{
+		case SINK_LEMONBAR:
+		case SINK_SHM:
+		case SINK_DELTA:
+			// Don't touch the bar's segment, it might still be in use
+			if (block->restyle || block->tmpl.head.str == NULL)
+			{
+				compile_block(&state->lemon, block);
+			}
+			res = blockstr(block, segment) < 0 ? -1 : 0;
+			break;
+		case SINK_PLAIN:
+			res = plain_block(block, segment, 0);
+			break;
+		case SINK_I3BAR:
+			res = i3bar_block(block, segment);
+			break;
+		case SINK_TSV:
+			res = plain_block(block, segment, 1);
+			break;
+		default:
+			res = -1;
+	}
+
+	sink->versions[idx] = block->version;
+	return res;
+}
+
+/*
+ * Copies `len` bytes of `str` and a null terminator to offset `off` of the 
+ * shared memory segment and returns the offset right after them.
+ */
+static size_t put_shm(shm_s *shm, size_t off, const char *str, size_t len)
+{
+	char *dst = (char *) shm + off;
+	memcpy(dst, str, len);
+	dst[len] = '\0';
+	return off + len + 1;
+}
+
+/*
+ * Publishes the frame in the given shm sink's output buffer, followed by 
+ * the names and outputs of all blocks, to the sink's shared memory, growing 
+ * it if needed. Readers are expected to check the sequence number before and 
+ * after reading, see shm_begin(). Returns 0 on success, -1 on error.
+ */
+static int publish_shm(state_s *state, sink_s *sink)
+{
+	size_t head = sizeof(shm_s) + state->num_blocks * sizeof(shm_block_s);
+	size_t need = head + sink->out.len + 1;
+	for (size_t i = 0; i < state->num_blocks; ++i)
+	{
+		need += strlen(state->blocks[i].sid) + 1;
+		need += state->blocks[i].output_len + 1;
+	}
+
+	if (need > sink->shm_size && 
+			shm_grow(&sink->shm, &sink->shm_size, need, sink->fd) == -1)
+	{
+		return -1;
+	}
+
+	shm_s *shm = sink->shm;
+	shm_begin(shm);
+
+	shm->frame     = head;
+	shm->frame_len = sink->out.len;
+	size_t off = put_shm(shm, head, sink->out.str, sink->out.len);
+
+	thing_s *block = NULL;
+	for (size_t i = 0; i < state->num_blocks; ++i)
+	{
+		block = &state->blocks[i];
+		size_t name_len = strlen(block->sid);
+
+		shm->blocks[i].name     = off;
+		shm->blocks[i].name_len = name_len;
+		off = put_shm(shm, off, block->sid, name_len);
+
+		// Live blocks might not have a result available
+		shm->blocks[i].output     = off;
+		shm->blocks[i].output_len = block->output ? block->output_len : 0;
+		off = put_shm(shm, off, block->output ? block->output : "", 
+				shm->blocks[i].output_len);
+	}
+
+	shm->frames += 1;
+	shm_end(shm);
+	return 0;
+}
+
+/*
+ * Renders a frame for the given delta sink and appends it to the sink's 
+ * output buffer. A frame starts with a "key" or "delta" line and ends with 
+ * an empty line; in between, there is one "<block>\t<markup>" line for every 
+ * block whose output changed since the last frame. Keyframes list all blocks,
+ * in order, with a lemonbar alignment tag on a line of its own in front of 
+ * the first block and wherever the alignment changes. They are sent for the 
+ * first frame, every DELTA_KEYFRAME frames and after a frame had to be 
+ * dropped, so that consumers can always catch up. Returns 1 if a frame was 
+ * added, 0 if not.
+ */
+static int render_delta(state_s *state, sink_s *sink)
+{
+	int key = sink->frames >= sink->next_key;
+	size_t start = sink->out.len;
+	int last_align = -2; // none, so the first block's alignment is stated
+	int num = 0;
+	int res = 0;
+
+	res |= strbuf_puts(&sink->out, key ? "key\n" : "delta\n");
+
+	thing_s *block = NULL;
+	for (size_t i = 0; i < state->num_blocks; ++i)
+	{
+		block = &state->blocks[i];
+		strbuf_s *segment = &sink->segments[i];
+		int changed = segment->str == NULL || sink->versions[i] != block->version;
+
+		// Live blocks might not have a result available
+		int ready = block->output && render_sink_block(state, sink, i) == 0;
+
+		if (key)
+		{
+			int block_align = cfg_get_int(&block->cfg, BLOCK_OPT_ALIGN);
+			if (block_align != last_align)
+			{
+				res |= strbuf_printf(&sink->out, "%%{%c}\n", "lcr"[block_align + 1]);
+			}
+			last_align = block_align;
+		}
+		else if (!changed || !ready)
+		{
+			continue;
+		}
+
+		res |= strbuf_puts(&sink->out, block->sid);
+		res |= strbuf_puts(&sink->out, "\t");
+		if (ready)
+		{
+			res |= strbuf_append(&sink->out, segment->str, segment->len);
+		}
+		res |= strbuf_puts(&sink->out, "\n");
+		++num;
+	}
+	res |= strbuf_puts(&sink->out, "\n");
+
+	// Out of memory; blocks might have been marked as sent, so resend all
+	if (res)
+	{
+		sink->out.len = start;
+		if (sink->out.str)
+		{
+			sink->out.str[start] = '\0';
+		}
+		sink->next_key = sink->frames;
+		return 0;
+	}
+
+	// Nothing changed since the last frame, no need to write anything
+	if (num == 0 && !key)
+	{
+		sink->out.len = start;
+		sink->out.str[start] = '\0';
+		return 0;
+	}
+
+	// The sink isn't keeping up, drop the frame, a keyframe will follow
+	if (sink->out.len > BUFFER_LOG)
+	{
+		sink->out.len = start;
+		sink->out.str[start] = '\0';
+		sink->next_key = sink->frames;
+		++sink->dropped;
+		return 0;
+	}
+
+	if (key)
+	{
+		sink->next_key = sink->frames + DELTA_KEYFRAME;
+	}
+	++sink->frames;
+	return 1;
+}
+
+/*
+ * Renders a frame for the given sink and appends it to the sink's output 
+ * buffer, unless it is identical to the last frame, or the buffer is full,
+ * because the sink hasn't been taking any output for a while. In that case,
+ * the frame is dropped. Returns 1 if a frame was added, 0 if not.
+ */
+static int render_sink(state_s *state, sink_s *sink)
+{
+	if (sink->type == SINK_DELTA)
+	{
+		return render_delta(state, sink);
+	}
+
+	char *sep = cfg_get_str(&state->lemon.cfg, LEMON_OPT_SEPARATOR);
+	size_t start = sink->out.len;
+	int last_align = -1;
+	int num = 0;
+
+	if (sink->type == SINK_I3BAR)
+	{
+		strbuf_puts(&sink->out, "[");
+	}
+
+	thing_s *block = NULL;
+	for (size_t i = 0; i < state->num_blocks; ++i)
+	{
+		block = &state->blocks[i];
+
+		// Keep the columns in place, even if a block has no output yet
+		if (sink->type == SINK_TSV && num++)
+		{
+			strbuf_puts(&sink->out, "\t");
+		}
+
+		// Live blocks might not have a result available
+		if (block->output == NULL || render_sink_block(state, sink, i) == -1)
+		{
+			continue;
+		}
+
+		int block_align = cfg_get_int(&block->cfg, BLOCK_OPT_ALIGN);
+		int same_align = block_align == last_align;
+
+		switch (sink->type)
+		{
+			case SINK_LEMONBAR:
+			case SINK_SHM:
+				if (!same_align)
+				{
+					strbuf_printf(&sink->out, "%%{%c}", "lcr"[block_align + 1]);
+				}
+				if (sep && same_align && num)
+				{
+					strbuf_puts(&sink->out, sep);
+				}
+				++num;
+				break;
+			case SINK_PLAIN:
+				if (num++)
+				{
+					strbuf_puts(&sink->out, sep ? sep : " ");
+				}
+				break;
+			case SINK_I3BAR:
+				if (num++)
+				{
+					strbuf_puts(&sink->out, ",");
+				}
+				break;
+			default:
+				break;
+		}
+		last_align = block_align;
+
+		strbuf_append(&sink->out, sink->segments[i].str, sink->segments[i].len);
+	}
 
-static thing_s *get_spark(state_s *state, void *block, const char *cmd)
-{
-	for (size_t i = 0; i < state->num_sparks; ++i)
+	const char *end = sink->type == SINK_I3BAR ? "],\n" : "\n";
+	if (strbuf_puts(&sink->out, sink->type == SINK_SHM ? "" : end) == -1)
 	{
-		if (state->sparks[i].other != block)
-		{
-			continue;
-		}
-		if (!equals(state->sparks[i].child->cmd, cmd))
-		{
-			continue;
-		}
-		return &state->sparks[i];
+		sink->out.len = start;
+		return 0;
 	}
-	return NULL;
-}
 
-static thing_s *add_spark(state_s *state, thing_s *block, const char *cmd)
-{
-	// See if there is an existing spark that matches the given params
-	thing_s *es = get_spark(state, block, cmd);
-	if (es)
+	// Same as the last frame, no need to write it
+	uint64_t h = hash(sink->out.str + start, sink->out.len - start, OUTPUT_HASH_SEED);
+	if (sink->frames && h == sink->hash)
 	{
-		return es;
+		sink->out.len = start;
+		sink->out.str[start] = '\0';
+		return 0;
 	}
 
-	// Resize the spark array to be able to hold one more spark
-	size_t current  =   state->num_sparks;
-	size_t new_size = ++state->num_sparks * sizeof(thing_s);
-	thing_s *sparks = realloc(state->sparks, new_size);
-	if (sparks == NULL)
+	// Shared memory is written right away, readers can't hold us up
+	if (sink->type == SINK_SHM)
 	{
-		fprintf(stderr, "add_spark(): realloc() failed!\n");
-		--state->num_sparks;
-		return NULL;
+		int res = publish_shm(state, sink);
+		strbuf_reset(&sink->out);
+		if (res == -1)
+		{
+			++sink->dropped;
+			return 0;
+		}
 	}
-	state->sparks = sparks; 
-	 
-	state->sparks[current] = (thing_s) { 0 };
-	state->sparks[current].t_type = THING_SPARK;
-	state->sparks[current].other  = block;
 
-	// Add a reference of this spark to the block we've created it for
-	block->other = &state->sparks[current];
+	// The sink isn't keeping up, drop the frame, a newer one will follow
+	if (sink->out.len > BUFFER_LOG)
+	{
+		sink->out.len = start;
+		sink->out.str[start] = '\0';
+		++sink->dropped;
+		return 0;
+	}
 
-	// Return a pointer to the new spark
-	return &state->sparks[current];
+	sink->hash = h;
+	++sink->frames;
+	return 1;
 }
 
-static size_t create_sparks(state_s *state)
+/*
+ * Writes as much of the sinks' pending output as they will take without 
+ * blocking. Returns the number of bytes written.
+ */
+static size_t flush_sinks(state_s *state)
 {
-	thing_s *block = NULL;
-	for (size_t i = 0; i < state->num_blocks; ++i)
+	size_t num_written = 0;
+	sink_s *sink = NULL;
+	for (size_t i = 0; i < state->num_sinks; ++i)
 	{
-		block = &state->blocks[i];
-
-		if (block->b_type != BLOCK_SPARKED)
+		sink = &state->sinks[i];
+		if (sink->out.len == 0)
 		{
 			continue;
 		}
 
-		char *trigger = cfg_get_str(&block->cfg, BLOCK_OPT_TRIGGER);
-		if (empty(trigger))
+		ssize_t n = write(sink->fd, sink->out.str, sink->out.len);
+		if (n == -1)
 		{
-			fprintf(stderr, "create_sparks(): missing trigger for sparked block '%s'\n", block->sid);
+			// The reader of a pipe went away (EPIPE) or the like
+			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+			{
+				fprintf(stderr, "Failed to write to sink, closing: %s\n", sink->path);
+				strbuf_reset(&sink->out);
+				close(sink->fd);
+				sink->fd = -1;
+			}
 			continue;
 		}
 
-		add_spark(state, block, trigger);
-	}
-
-	for (size_t i = 0; i < state->num_sparks; ++i)
-	{
-		char *trigger = cfg_get_str(&state->sparks[i].other->cfg, BLOCK_OPT_TRIGGER);
-		state->sparks[i].child = make_child(state, trigger, 0, 1, 0);
+		memmove(sink->out.str, sink->out.str + n, sink->out.len - n + 1);
+		sink->out.len -= n;
+		num_written += n;
 	}
-
-	return state->num_sparks;
+	return num_written;
 }
 
 /*
- * Run a command in a 'fire and forget' manner. Does not invoke a shell,
- * hence no shell built-in functionality can be used in the command.
- * Returns 0 on success, -1 on error.
+ * Renders a frame for every sink that is still open, if an update is due and
+ * the bar's max-fps allows for it (see feed_lemon()), then writes them out. 
+ * Unlike the bar, sinks are fed even while the bar is being restarted or is 
+ * busy, hence they keep track of their own updates and frame times.
  */
-int run_cmd(const char *cmd)
+static void feed_sinks(state_s *state, double now)
 {
-	kita_child_s *child = kita_child_new(cmd, 0, 0, 0);
-	if (child == NULL)
+	if (state->sinks_due == 0 || state->num_sinks == 0)
 	{
-		return -1;
+		return;
 	}
 
-	if (kita_child_open(child) == -1) // runs the child via fork/execvp
+	if (frame_due_in(state, state->last_sinks, now) * MILLISEC_PER_SEC >= 1.0)
 	{
-		return -1;
+		return;
 	}
 
-	kita_child_close(child); // does not stop the child, just closes com channels
-	kita_child_free(&child);
-	return 0;
+	for (size_t i = 0; i < state->num_sinks; ++i)
+	{
+		if (state->sinks[i].fd != -1)
+		{
+			render_sink(state, &state->sinks[i]);
+		}
+	}
+	state->last_sinks = now;
+	state->sinks_due = 0;
+	flush_sinks(state);
 }
 
 /*
- * Takes a string that might represent an action that was registered with one 
- * of the blocks and tries to find the associated block. If found, the command
- * associated with the action will be executed.
- * Returns 0 on success, -1 if the string was not a recognized action command
- * or the block that the action belongs to could not be found.
+ * Opens the sinks given in the bar's `sinks` option, a space-separated list 
+ * of <format>:<path> entries, where format is one of "lemonbar", "plain", 
+ * "i3bar", "tsv", "shm" and "delta" and path is the file to write to, or "-" for 
+ * stdout; for "shm", it is the name of the shared memory object instead.
+ * Invalid entries and files that can't be opened are reported and skipped.
+ * Returns the number of sinks opened.
  */
-static int process_action(const state_s *state, const char *action)
+static size_t open_sinks(state_s *state)
 {
-	// A valid action command should have the format <blockname>_<cmd-type>
-	// For example, for a block named `datetime` that was clicked with the 
-	// left mouse button, `action` should be "datetime_lmb"
+	static const char *names[SINK_COUNT] = { 
+		"lemonbar", "plain", "i3bar", "tsv", "shm", "delta" 
+	};
 
-	size_t len = strlen(action);
-	if (len < 5) 
+	const char *sinks = cfg_get_str(&state->lemon.cfg, LEMON_OPT_SINKS);
+	if (sinks == NULL)
 	{
-		return -1;	// Can not be an action command, too short
+		return 0;
 	}
-	
-	// Extract the type suffix, including the underscore
-	char type[5]; 
-	snprintf(type, 5, "%s", action + len - 4);
-
-	// Extract everything _before_ the suffix (this is the block name)
-	char block[len-3];
-	snprintf(block, len - 3, "%s", action); 
 
-	// Find the source block of the action
-	thing_s *source = get_block(state, block);
-	if (source == NULL)
+	char *list = strdup(sinks);
+	char *save = NULL;
+	for (char *entry = strtok_r(list, " ", &save); entry; entry = strtok_r(NULL, " ", &save))
 	{
-		return -1;
-	}
+		char *path = strchr(entry, ':');
+		if (path)
+		{
+			*path++ = '\0';
+		}
 
-	// Now to fire the right command for the action type
-	if (equals(type, "_lmb"))
-	{
-		return run_cmd(cfg_get_str(&source->cfg, BLOCK_OPT_CMD_LMB));
-	}
-	if (equals(type, "_mmb"))
-	{
-		return run_cmd(cfg_get_str(&source->cfg, BLOCK_OPT_CMD_MMB));
-	}
-	if (equals(type, "_rmb"))
-	{
-		return run_cmd(cfg_get_str(&source->cfg, BLOCK_OPT_CMD_RMB));
-	}
-	if (equals(type, "_sup"))
-	{
-		return run_cmd(cfg_get_str(&source->cfg, BLOCK_OPT_CMD_SUP));
-	}
-	if (equals(type, "_sdn"))
-	{
-		return run_cmd(cfg_get_str(&source->cfg, BLOCK_OPT_CMD_SDN));
+		int type = -1;
+		for (int t = 0; t < SINK_COUNT; ++t)
+		{
+			if (equals(entry, names[t]))
+			{
+				type = t;
+			}
+		}
+		if (type == -1 || empty(path))
+		{
+			fprintf(stderr, "Invalid sink, skipping: %s\n", entry);
+			continue;
+		}
+
+		// Opening stdout anew gives us our own, non-blocking file description
+		int fd = -1;
+		shm_s *shm = NULL;
+		if (type == SINK_SHM)
+		{
+			shm = shm_create(path, BUFFER_SHM, state->num_blocks, &fd);
+		}
+		else
+		{
+			fd = open(equals(path, "-") ? "/dev/stdout" : path, 
+				O_WRONLY | O_APPEND | O_CREAT | O_NONBLOCK | O_CLOEXEC, 0644);
+		}
+		if (fd == -1 || (type == SINK_SHM && shm == NULL))
+		{
+			fprintf(stderr, "Failed to open sink, skipping: %s\n", path);
+			continue;
+		}
+
+		sink_s *sink = realloc(state->sinks, (state->num_sinks + 1) * sizeof(sink_s));
+		if (sink == NULL)
+		{
+			if (shm)
+			{
+				shm_close(shm, BUFFER_SHM, fd, path);
+			}
+			else
+			{
+				close(fd);
+			}
+			break;
+		}
+		state->sinks = sink;
+		sink = &state->sinks[state->num_sinks++];
+
+		*sink = (sink_s) { 0 };
+		sink->type     = type;
+		sink->fd       = fd;
+		sink->path     = strdup(path);
+		sink->segments = calloc(state->num_blocks, sizeof(strbuf_s));
+		sink->versions = calloc(state->num_blocks, sizeof(size_t));
+		sink->shm      = shm;
+		sink->shm_size = BUFFER_SHM;
+
+		// The i3bar protocol starts with a header and an endless array
+		if (type == SINK_I3BAR)
+		{
+			strbuf_puts(&sink->out, "{\"version\":1}\n[\n");
+		}
 	}
 
-	// Invalid action type (how in the world did that happen?)
-	return -1;
+	free(list);
+	return state->num_sinks;
 }
 
-static void feed_lemon(state_s *state)
+/*
+ * Writes out what we can, then closes and frees all sinks.
+ */
+static void free_sinks(state_s *state)
 {
-	if (state->due == 0)
+	flush_sinks(state);
+
+	sink_s *sink = NULL;
+	for (size_t i = 0; i < state->num_sinks; ++i)
 	{
-		return;
+		sink = &state->sinks[i];
+		for (size_t b = 0; b < state->num_blocks; ++b)
+		{
+			strbuf_free(&sink->segments[b]);
+		}
+		free(sink->segments);
+		free(sink->versions);
+		strbuf_free(&sink->out);
+		if (sink->shm)
+		{
+			shm_close(sink->shm, sink->shm_size, sink->fd, sink->path);
+		}
+		else if (sink->fd != -1)
+		{
+			close(sink->fd);
+		}
+		free(sink->path);
 	}
 
-	char *input = barstr(state);
-	kita_child_feed(state->lemon.child, input);
-	free(input);
-	state->due = 0;
+	free(state->sinks);
+	state->sinks = NULL;
+	state->num_sinks = 0;
 }
 
 /*
@@ -1007,6 +3307,27 @@ void on_signal(int sig)
 	handled = sig;
 }
 
+/*
+ * Handles SIGPIPE if the bar is to be restarted or there are sinks, as writing
+ * to the bar after it died, or to a pipe without a reader, is to be expected 
+ * then; write() fails with EPIPE instead. We don't use SIG_IGN, as that would
+ * be inherited by all child processes.
+ */
+void on_pipe(int sig)
+{
+	handled = sig;
+}
+
+/*
+ * Handles SIGUSR1 by setting the static variable `reporting` to 1, so that 
+ * the main loop will print a usage report on its next iteration.
+ */
+void on_report(int sig)
+{
+	reporting = 1;
+	handled = sig;
+}
+
 static thing_s *thing_by_child(state_s *state, kita_child_s *child)
 {
 	// lemon
@@ -1033,6 +3354,24 @@ static thing_s *thing_by_child(state_s *state, kita_child_s *child)
 		}
 	}
 
+	// sources
+	for (size_t i = 0; i < state->num_sources; ++i)
+	{
+		if (child == state->sources[i].child)
+		{
+			return &state->sources[i];
+		}
+	}
+
+	// actions
+	for (size_t i = 0; i < state->num_actions; ++i)
+	{
+		if (child == state->actions[i].child)
+		{
+			return &state->actions[i];
+		}
+	}
+
 
 	// not found
 	return NULL;
@@ -1065,17 +3404,11 @@ void on_child_readok(kita_state_s *ks, kita_event_s *ke)
 	{
 		if (ke->ios == KITA_IOS_OUT)
 		{
-			char *output = kita_child_read(ke->child, ke->ios);
-			process_action(state, output);
-			free(output);
+			process_actions(state);
 		}
 		else
 		{
-			// TODO user should be able to choose whether this ...
-			//      - ... will be ignored
-			//      - ... will be printed to stderr
-			//      - ... will be logged to a file
-			fprintf(stderr, "%s\n", kita_child_read(ke->child, ke->ios));
+			read_errors(state, thing);
 		}
 		return;
 	}
@@ -1088,27 +3421,52 @@ void on_child_readok(kita_state_s *ks, kita_event_s *ke)
 			// different from its previous output
 			if (read_block(thing))
 			{
-				state->due = 1;
+				share_output(thing);
+				update_block(state, thing, thing->last_read);
 			}
 		}
 		else
 		{
-			// TODO implement block mode switch logic
-
+			read_errors(state, thing);
 		}
 		return;
 	}
 
 	if (thing->t_type == THING_SPARK)
+	{
+		if (ke->ios == KITA_IOS_OUT && read_spark(thing))
+		{
+			trigger_blocks(thing);
+		}
+		return;
+	}
+
+	if (thing->t_type == THING_SOURCE)
 	{
 		if (ke->ios == KITA_IOS_OUT)
 		{
-			read_spark(thing);
+			route_output(state, thing);
+		}
+		else
+		{
+			read_errors(state, thing);
 		}
 		return;
 	}
 }
 
+/*
+ * The bar is ready for more input; write whatever is left of the last frame.
+ */
+void on_child_feedok(kita_state_s *ks, kita_event_s *ke)
+{
+	state_s *state = (state_s*) kita_child_get_context(ke->child);
+	if (ke->child == state->lemon.child)
+	{
+		write_frame(state);
+	}
+}
+
 void on_child_closed(kita_state_s *ks, kita_event_s *ke)
 {
 	//fprintf(stderr, "on_child_closed(): %s\n", ke->child->cmd);
@@ -1128,7 +3486,29 @@ void on_child_exited(kita_state_s *ks, kita_event_s *ke)
 	
 	if (thing->t_type == THING_LEMON)
 	{
-		running = 0;
+		if (cfg_get_int(&thing->cfg, LEMON_OPT_RESTART) == 0)
+		{
+			running = 0;
+			return;
+		}
+
+		// we might get here more than once for the same process
+		if (thing->alive)
+		{
+			double now = get_time();
+			thing->alive = 0;
+
+			// bar has been running for a while, it's not crashing repeatedly
+			if (now - thing->last_open > LEMON_BACKOFF_MAX)
+			{
+				state->backoff = LEMON_BACKOFF_MIN;
+			}
+
+			fprintf(stderr, "Bar exited, restarting in %.0f s\n", state->backoff);
+			state->restart = now + state->backoff;
+			state->backoff = state->backoff * 2 > LEMON_BACKOFF_MAX ? 
+				LEMON_BACKOFF_MAX : state->backoff * 2;
+		}
 		return;
 	}
 
@@ -1138,11 +3518,22 @@ void on_child_exited(kita_state_s *ks, kita_event_s *ke)
 		return;
 	}
 	
-	if (thing->t_type == THING_SPARK)
+	if (thing->t_type == THING_SPARK || thing->t_type == THING_SOURCE)
 	{
 		thing->alive = 0;
 		return;
 	}
+
+	if (thing->t_type == THING_ACTION)
+	{
+		// we might get here more than once for the same process
+		if (thing->alive)
+		{
+			thing->alive = 0;
+			--thing->other->num_running;
+		}
+		return;
+	}
 }
 
 void on_child_reaped(kita_state_s *ks, kita_event_s *ke)
@@ -1153,6 +3544,24 @@ void on_child_reaped(kita_state_s *ks, kita_event_s *ke)
 
 static void cleanup(state_s *state)
 {
+	// remove cgroup leaves (killing what's left in them)
+	remove_cgroups(state);
+
+	// free actions
+	for (size_t i = 0; i < state->num_actions; ++i)
+	{
+		free_thing(&state->actions[i]);
+	}
+	free(state->actions);
+	state->actions = NULL;
+	state->num_actions = 0;
+
+	// free sources
+	free_sources(state);
+	free(state->sources);
+	state->sources = NULL;
+	state->num_sources = 0;
+
 	// free sparks
 	free_sparks(state);
 	free(state->sparks);
@@ -1162,6 +3571,9 @@ static void cleanup(state_s *state)
 	// free albedo
 	free_thing(&state->albedo);
 
+	// free sinks (before the blocks, as they have segments for each)
+	free_sinks(state);
+
 	// free blocks
 	free_blocks(state);
 	free(state->blocks);
@@ -1170,6 +3582,18 @@ static void cleanup(state_s *state)
 
 	// free bar
 	free_thing(&state->lemon);
+	free(state->frame);
+	state->frame = NULL;
+
+	// free log, writing out what we can
+	flush_log(state);
+	if (state->log_fd != STDERR_FILENO)
+	{
+		close(state->log_fd);
+	}
+	free(state->log);
+	state->log = NULL;
+	state->log_len = 0;
 
 	// free kita
 	kita_free(&state->kita);
@@ -1212,6 +3636,10 @@ int main(int argc, char **argv)
 	sigaction(SIGQUIT, &sa_int, NULL);
 	sigaction(SIGTERM, &sa_int, NULL);
 	sigaction(SIGPIPE, &sa_int, NULL);
+
+	struct sigaction sa_usr = { .sa_handler = &on_report };
+
+	sigaction(SIGUSR1, &sa_usr, NULL);
 	
 	//
 	// CHECK FOR X 
@@ -1244,6 +3672,10 @@ int main(int argc, char **argv)
 
 	kita_state_s *kita = state.kita; // For convenience
 	kita_set_option(kita, KITA_OPT_NO_NEWLINE, 1);
+	kita_set_option(kita, KITA_OPT_LAST_LINE, 1);
+
+	// Actions have no streams, we'd only notice them ending by chance
+	kita_wake_on_exit(kita);
 
 	// 
 	// KITA CALLBACKS 
@@ -1254,6 +3686,7 @@ int main(int argc, char **argv)
 	kita_set_callback(kita, KITA_EVT_CHILD_HANGUP, on_child_exited);
 	kita_set_callback(kita, KITA_EVT_CHILD_EXITED, on_child_exited);
 	kita_set_callback(kita, KITA_EVT_CHILD_READOK, on_child_readok);
+	kita_set_callback(kita, KITA_EVT_CHILD_FEEDOK, on_child_feedok);
 	kita_set_callback(kita, KITA_EVT_CHILD_ERROR,  on_child_error);
 
 	//
@@ -1342,6 +3775,30 @@ int main(int argc, char **argv)
 		fprintf(stderr, "Failed to create bar process: %s\n", lemon_bin);
 		return EXIT_FAILURE;
 	}
+	kita_child_set_last_line(lemon->child, KITA_IOS_OUT, 0);
+	kita_child_set_last_line(lemon->child, KITA_IOS_ERR, 0);
+
+	// open the log file, if any, or log to our own stderr
+	int log_flags = O_WRONLY | O_APPEND | O_CREAT | O_NONBLOCK | O_CLOEXEC;
+	char *log_path = cfg_get_str(&lemon->cfg, LEMON_OPT_LOG);
+	state.log_fd = log_path ? open(log_path, log_flags, 0644) : -1;
+	if (log_path && state.log_fd == -1)
+	{
+		fprintf(stderr, "Failed to open log file, using stderr: %s\n", log_path);
+	}
+
+	// Opening stderr anew gives us our own, non-blocking file description,
+	// so a stalled reader (pipe, terminal) can't hold us up; regular files
+	// don't block, and we'd be writing at a different offset than stderr
+	struct stat err_stat = { 0 };
+	if (state.log_fd == -1 && fstat(STDERR_FILENO, &err_stat) == 0 && !S_ISREG(err_stat.st_mode))
+	{
+		state.log_fd = open("/dev/stderr", log_flags, 0644);
+	}
+	if (state.log_fd == -1)
+	{
+		state.log_fd = STDERR_FILENO;
+	}
 
 	// open (run) the lemon
 	if (open_lemon(lemon) == -1)
@@ -1350,6 +3807,14 @@ int main(int argc, char **argv)
 		return EXIT_FAILURE;
 	}
 
+	// if the bar is to be restarted, writing to it after it died is fine
+	if (cfg_get_int(&lemon->cfg, LEMON_OPT_RESTART))
+	{
+		struct sigaction sa_pipe = { .sa_handler = &on_pipe };
+		sigaction(SIGPIPE, &sa_pipe, NULL);
+		state.backoff = LEMON_BACKOFF_MIN;
+	}
+
 	//
 	// ALBEDO - the 'default' block config
 	//
@@ -1359,6 +3824,7 @@ int main(int argc, char **argv)
 	albedo->t_type = THING_BLOCK;
 	albedo->b_type = BLOCK_NONE;
 	cfg_init(&albedo->cfg, ALBEDO_SID, BLOCK_OPT_COUNT);
+	cfg_set_int(&albedo->cfg, BLOCK_OPT_MAX_BYTES, BLOCK_MAX_BYTES);
 	
 	//
 	// BLOCKS
@@ -1385,14 +3851,18 @@ int main(int argc, char **argv)
 		return EXIT_FAILURE;
 	}
 
-	// create child processes and add them to the kita state
+	// blocks can get their output from a source section, parse those
+	if (create_muxes(&state) && load_source_cfg(&state) < 0)
+	{
+		fprintf(stderr, "Failed to load config file: %s\n", prefs->config);
+		return EXIT_FAILURE;
+	}
+
+	// merge albedo (default config) with the blocks' configs
 	thing_s *block = NULL;
 	for (size_t i = 0; i < state.num_blocks; ++i)
 	{
 		block = &state.blocks[i];
-		char *block_bin = cfg_get_str(&block->cfg, BLOCK_OPT_BIN);
-		char *block_cmd = block_bin ? block_bin : block->sid;
-		block->child = make_child(&state, block_cmd, 0, 1, 1);
 
 		// merge albedo (default config) with this block's config
 		for (int i = 0; i < BLOCK_OPT_COUNT; ++i)
@@ -1417,12 +3887,62 @@ int main(int argc, char **argv)
 		}
 	}
 
+	// find blocks that can share the output of another block
+	share_blocks(&state);
+
+	// create child processes and add them to the kita state
+	for (size_t i = 0; i < state.num_blocks; ++i)
+	{
+		block = &state.blocks[i];
+		if (block->source == NULL)
+		{
+			block->child = make_child(&state, block_cmd(block), 0, 1, 1);
+			int max_bytes = cfg_get_int(&block->cfg, BLOCK_OPT_MAX_BYTES);
+			kita_child_set_max_line(block->child, KITA_IOS_OUT, max_bytes > 0 ? max_bytes : 0);
+			kita_child_set_max_line(block->child, KITA_IOS_ERR, BUFFER_ERR_LINE - 1);
+			kita_child_set_last_line(block->child, KITA_IOS_ERR, 0);
+		}
+	}
+
+	//
+	// SOURCES
+	//
+
+	thing_s *mux = NULL;
+	for (size_t i = 0; i < state.num_sources; ++i)
+	{
+		mux = &state.sources[i];
+		mux->child = make_child(&state, block_cmd(mux), 0, 1, 1);
+		kita_child_set_max_line(mux->child, KITA_IOS_OUT, source_max_line(mux));
+		kita_child_set_last_line(mux->child, KITA_IOS_OUT, 0);
+		kita_child_set_max_line(mux->child, KITA_IOS_ERR, BUFFER_ERR_LINE - 1);
+		kita_child_set_last_line(mux->child, KITA_IOS_ERR, 0);
+	}
+
+	// compile the (static parts of the) block strings
+	compile_blocks(&state);
+
+	// open additional outputs, if any
+	if (open_sinks(&state))
+	{
+		struct sigaction sa_pipe = { .sa_handler = &on_pipe };
+		sigaction(SIGPIPE, &sa_pipe, NULL);
+	}
+
 	//
 	// SPARKS
 	//
 
 	create_sparks(&state);
+
+	//
+	// CGROUPS
+	//
+
+	create_cgroups(&state);
+
 	open_sparks(&state);
+	open_sources(&state);
 	
 	//
 	// MAIN LOOP
@@ -1444,17 +3964,43 @@ int main(int argc, char **argv)
 
 		//fprintf(stderr, "> now = %f, wait = %f, delta = %f\n", now, wait, delta);
 
+		// restart the bar, if it has exited and is due for a restart
+		restart_lemon(&state, now);
+
 		// open all blocks that are due for (another) invocation
 		open_due_blocks(&state, now);
 
-		// feed lemon (if the state's 'due' field is set)
-		feed_lemon(&state);
+		// run all coalesced actions whose debounce window has passed
+		run_due_actions(&state, now);
+
+		// show the last output of rate-limited blocks, if it's due
+		flush_updates(&state, now);
+
+		// feed the sinks and lemon (if the state's 'due' field is set)
+		feed_sinks(&state, now);
+		feed_lemon(&state, now);
 
 		// let kita check for child events (for up to `wait` seconds)
 		kita_tick(kita, (wait == -1 ? wait : wait * MILLISEC_PER_SEC));
 
+		// forget about actions that have finished running
+		prune_actions(&state);
+
+		// write whatever stderr output has been logged in this iteration
+		flush_log(&state);
+
+		// write whatever the sinks haven't taken yet
+		flush_sinks(&state);
+
 		// figure out how long we can idle, based on timed blocks
 		wait = time_to_wait(&state, now);
+
+		// print a usage report, if requested via SIGUSR1
+		if (reporting)
+		{
+			report(&state, stderr);
+			reporting = 0;
+		}
 	}
 
 	//
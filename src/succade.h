@@ -3,6 +3,8 @@
 
 #include "libkita.h"
 #include <unistd.h> // STDOUT_FILENO, STDIN_FILENO, STDERR_FILENO
+#include <stdint.h> // uint64_t
+#include <sys/uio.h> // struct iovec
 
 #define DEBUG 0
 
@@ -13,14 +15,23 @@
 #define SUCCADE_VER_PATCH 3
 
 #define BUFFER_NUMERIC          8
-#define BUFFER_LEMON_ARG     1024
 
 #define BUFFER_BLOCK_NAME      64
 #define BUFFER_BLOCK_RESULT   256
-#define BUFFER_BLOCK_STR     2048
+
+#define BUFFER_ERR_LINE       256
+#define BUFFER_LOG          65536
+#define WRITE_RETRY          0.05 // seconds until writing to a full log/sink again
+
+#define BLOCK_MAX_BYTES      1024
+#define BLOCK_ERR_LINES         8
+#define BLOCK_TRUNC_MARK     "\xe2\x80\xa6" // U+2026 (ellipsis)
 
 #define BLOCK_WAIT_TOLERANCE 0.1
+#define CGROUP_REMOVE_TRIES    20 // 10 ms apart, see cgroup_remove()
+#define ACTION_REPEAT_ENV    "SUCCADE_REPEAT"
 #define MILLISEC_PER_SEC     1000
+#define OUTPUT_HASH_SEED     0x5ccade5ccade5ccaULL
 
 #define DEFAULT_CFG_FILE "succaderc"
 
@@ -30,6 +41,15 @@
 #define DEFAULT_LEMON_NAME    "succade_lemonbar"
 #define DEFAULT_LEMON_SECTION "bar"
 
+#define LEMON_BACKOFF_MIN     1.0
+#define LEMON_BACKOFF_MAX    60.0
+#define LEMON_FEED_SPANS     1024 // max spans per writev(), IOV_MAX on Linux
+
+#define SHM_MAGIC      0x53434144 // "SCAD", set once the header is valid
+#define SHM_VERSION             1 // layout of struct succade_shm, see README
+#define BUFFER_SHM           4096
+#define DELTA_KEYFRAME         60 // frames between keyframes of a delta sink
+
 //
 // ENUMS
 //
@@ -38,7 +58,9 @@ enum succade_thing_type
 {
 	THING_LEMON,
 	THING_BLOCK,
-	THING_SPARK
+	THING_SPARK,
+	THING_ACTION,
+	THING_SOURCE
 };
 
 enum succade_block_type
@@ -57,9 +79,32 @@ enum succade_fdesc_type
 	FD_ERR = STDERR_FILENO
 };
 
-typedef enum succade_thing_type thing_type_e;
-typedef enum succade_block_type block_type_e;
-typedef enum succade_fdesc_type fdesc_type_e;
+enum succade_action_type
+{
+	ACTION_LMB, // left mouse button
+	ACTION_MMB, // middle mouse button
+	ACTION_RMB, // right mouse button
+	ACTION_SUP, // scroll up
+	ACTION_SDN, // scroll down
+	ACTION_COUNT
+};
+
+enum succade_sink_type
+{
+	SINK_LEMONBAR, // lemonbar markup, same as fed to the bar
+	SINK_PLAIN,    // plain text, blocks joined by the separator
+	SINK_I3BAR,    // i3bar JSON protocol
+	SINK_TSV,      // blocks' plain text, separated by tabs
+	SINK_SHM,      // lemonbar markup and outputs, in shared memory
+	SINK_DELTA,    // lemonbar markup of changed blocks, plus keyframes
+	SINK_COUNT
+};
+
+typedef enum succade_thing_type  thing_type_e;
+typedef enum succade_block_type  block_type_e;
+typedef enum succade_fdesc_type  fdesc_type_e;
+typedef enum succade_action_type action_type_e;
+typedef enum succade_sink_type   sink_type_e;
 
 enum succade_lemon_opt
 {
@@ -81,6 +126,11 @@ enum succade_lemon_opt
 	LEMON_OPT_FG,          // -F: default foreground color
 	LEMON_OPT_LC,          // -U: underline color
 	LEMON_OPT_SEPARATOR,   // string to separate blocks with
+	LEMON_OPT_CGROUP,      // string: cgroup v2 dir for block processes
+	LEMON_OPT_RESTART,     // bool: restart the bar if it exits
+	LEMON_OPT_LOG,         // string: file to log stderr output to
+	LEMON_OPT_MAX_FPS,     // float: max number of frames per second
+	LEMON_OPT_SINKS,       // string: additional outputs, as format:path
 	LEMON_OPT_COUNT
 };
 
@@ -116,6 +166,17 @@ enum succade_block_opt
 	BLOCK_OPT_CMD_RMB,       // string: run on right click
 	BLOCK_OPT_CMD_SUP,       // string: run on scroll up
 	BLOCK_OPT_CMD_SDN,       // string: run on scroll down
+	BLOCK_OPT_CGROUP,        // string: name of the cgroup leaf
+	BLOCK_OPT_CPU_MAX,       // string: cgroup cpu.max value
+	BLOCK_OPT_MEMORY_MAX,    // string: cgroup memory.max value
+	BLOCK_OPT_SOURCE,        // string: block to mirror the output of
+	BLOCK_OPT_DEBOUNCE,      // float: window to coalesce actions in
+	BLOCK_OPT_ACTION_LIMIT,  // int: max number of running actions
+	BLOCK_OPT_MAX_BYTES,     // int: max length of output, in bytes
+	BLOCK_OPT_MAX_CHARS,     // int: max length of output, in characters
+	BLOCK_OPT_MAX_RATE,      // float: max number of updates per second
+	BLOCK_OPT_LOG,           // bool: log stderr output
+	BLOCK_OPT_STRUCTURED,    // bool: output consists of key=value fields
 	BLOCK_OPT_COUNT
 };
 
@@ -130,9 +191,89 @@ struct succade_thing;
 struct succade_prefs;
 struct succade_state;
 
+struct succade_tmpl;
+struct succade_strbuf;
+struct succade_attr;
+struct succade_sink;
+struct succade_shm;
+struct succade_shm_block;
+
 typedef struct succade_thing thing_s;
 typedef struct succade_prefs prefs_s;
 typedef struct succade_state state_s;
+typedef struct succade_tmpl  tmpl_s;
+typedef struct succade_strbuf strbuf_s;
+typedef struct succade_attr  attr_s;
+typedef struct succade_sink  sink_s;
+typedef struct succade_shm   shm_s;
+typedef struct succade_shm_block shm_block_s;
+
+struct succade_strbuf
+{
+	char         *str;       // null-terminated string (NULL until first use)
+	size_t        len;       // length of str, excluding null terminator
+	size_t        size;      // size of the buffer allocated for str
+};
+
+struct succade_attr
+{
+	char          font;      // font slot ('1' to '3') or '-' for default
+	const char   *fg;        // foreground color or "-" for default
+	const char   *bg;        // background color or "-" for default
+	const char   *lc;        // line color or "-" for default
+	int           ol;        // draw overline?
+	int           ul;        // draw underline?
+};
+
+struct succade_tmpl
+{
+	strbuf_s      head;      // everything in front of the output
+	strbuf_s      tail;      // everything after the output
+	int           padding_l; // number of spaces in front of the output
+	int           padding_r; // number of spaces after the output
+	int           min_width; // minimum width of the output
+};
+
+struct succade_sink
+{
+	sink_type_e   type;      // format to render the blocks in
+	char         *path;      // file to write to, "-" for stdout
+	int           fd;        // file descriptor of path
+	strbuf_s     *segments;  // rendered blocks, one for each block
+	size_t       *versions;  // block version each segment was rendered from
+	strbuf_s      out;       // rendered frames waiting to be written
+	uint64_t      hash;      // fingerprint of the last frame
+	size_t        frames;    // number of frames rendered
+	size_t        dropped;   // number of frames dropped, as out was full
+	size_t        next_key;  // frame number of the next keyframe (delta)
+	shm_s        *shm;       // mapped shared memory (shm sinks only)
+	size_t        shm_size;  // size of the mapping
+};
+
+// Offsets are in bytes from the start of the segment, strings are
+// null-terminated, lengths exclude the null terminator
+
+struct succade_shm_block
+{
+	uint32_t      name;      // offset of the block's name (section)
+	uint32_t      name_len;  // length of the block's name
+	uint32_t      output;    // offset of the block's output
+	uint32_t      output_len; // length of the block's output
+};
+
+struct succade_shm
+{
+	uint32_t      magic;     // SHM_MAGIC, once the header is set up
+	uint32_t      version;   // SHM_VERSION
+	uint32_t      seq;       // seqlock, odd while written; futex word
+	uint32_t      size;      // size of the segment, remap if it grows
+	int32_t       pid;       // PID of the writer, 0 once it has exited
+	uint32_t      frame;     // offset of the frame (lemonbar markup)
+	uint32_t      frame_len; // length of the frame
+	uint32_t      num_blocks; // number of entries in blocks
+	uint64_t      frames;    // number of frames published
+	shm_block_s   blocks[];  // one entry for every block, in bar order
+};
 
 struct succade_thing
 {
@@ -143,12 +284,39 @@ struct succade_thing
 
 	thing_type_e  t_type;    // thing type (lemon, block, spark?) 
 	block_type_e  b_type;    // block type (once, timed, sparked, live?)
-	thing_s      *other;     // associated block (for sparks) or spark (for blocks) 
+	thing_s      *other;     // associated spark (for blocks) or block (for actions)
+	thing_s      *source;    // block (or source) this block gets its output from
+	thing_s     **subs;      // blocks that mirror this block (or that a spark triggers)
+	size_t        num_subs;  // number of blocks in subs array
 
 	char         *output;    // last output from stdout
+	cfg_s         over;      // options overridden by (structured) output
+	unsigned char urgent : 1; // output asked for the block to stand out
+	tmpl_s        tmpl;      // compiled block string, see compile_block()
+	unsigned char restyle : 1; // overrides changed since tmpl was compiled?
+	strbuf_s      segment;   // rendered block string, see blockstr()
+	size_t        version;   // incremented whenever the output changes
+	unsigned char dirty : 1; // output changed since segment was rendered?
+	size_t        output_size; // size of the buffer allocated for output
+	size_t        output_len; // length of output, excluding null terminator
+	uint64_t      hash;      // fingerprint of the last output
+	size_t        suppressed; // number of reads that didn't change the output
+	size_t        truncated; // number of reads that had to be cut short
+	size_t        dropped;   // number of updates that were never shown
+	double        last_update; // timestamp (in seconds) of last shown update
+	unsigned char deferred : 1; // has an update waiting for max-rate?
+	char         *input;     // pending output of the block's spark, if any
+	char         *cgroup;    // path of the cgroup leaf, if any
+	char         *errors;    // last BLOCK_ERR_LINES lines from stderr (ring)
+	size_t        num_errors; // number of lines read from stderr so far
 	unsigned char alive : 1; // is up and running?
 	double        last_open; // timestamp (in seconds) of last open operation
 	double        last_read; // timestamp (in seconds) of last read operation
+
+	unsigned      pending[ACTION_COUNT]; // coalesced actions waiting to be run
+	double        last_action; // timestamp (in seconds) of last action event
+	size_t        num_running; // number of running action processes
+	unsigned      repeat;    // number of events an action was run for
 };
 
 struct succade_prefs
@@ -167,10 +335,36 @@ struct succade_state
 	thing_s  albedo;         // Dummy block for the default configuration
 	thing_s *blocks;         // Reference to block array
 	thing_s *sparks;         // Reference to spark array (prev. 'trigger')
+	thing_s *actions;        // Reference to running actions array
+	thing_s *sources;        // Reference to (multiplexed) source array
 	size_t   num_blocks;     // Number of blocks in blocks array
 	size_t   num_sparks;     // Number of sparks in sparks array
+	size_t   num_actions;    // Number of actions in actions array
+	size_t   num_sources;    // Number of sources in sources array
 	kita_state_s *kita;
+	struct iovec *frame;     // Last frame fed to the bar, as spans of bytes
+	size_t   frame_size;     // Number of spans allocated for frame
+	size_t   frame_spans;    // Number of spans in frame
+	size_t   frame_pos;      // First span of frame that isn't fully written
+	size_t   frame_len;      // Length of the last frame, in bytes
+	size_t   frame_sent;     // Bytes of the last frame written so far
+	size_t   num_frames;     // Number of frames fed to the bar
+	size_t   frame_bytes;    // Number of bytes fed to the bar, total
+	size_t   frames_suppressed; // Number of frames identical to the last one
+	size_t   frames_replaced; // Number of frames replaced before being sent
+	sink_s  *sinks;          // Additional outputs, besides the bar
+	size_t   num_sinks;      // Number of sinks in sinks array
+	uint64_t frame_hash;     // Fingerprint of the last frame
+	double   last_frame;     // Timestamp (in seconds) of the last frame
+	double   last_sinks;     // Timestamp (in seconds) of the sinks' last frame
+	double   backoff;        // Seconds to wait before the next bar restart
+	double   restart;        // Timestamp (in seconds) of next bar restart
+	int      log_fd;         // File descriptor to write the log to
+	char    *log;            // Log lines waiting to be written
+	size_t   log_len;        // Number of bytes waiting in the log buffer
+	size_t   log_dropped;    // Number of log lines dropped (buffer full)
 	unsigned char due : 1;
+	unsigned char sinks_due : 1; // Sinks need a new frame?
 };
 
 typedef void (*create_block_callback)(const char *name, int align, void *data);